@@ -0,0 +1,176 @@
+#include "ansi.hpp"
+
+#include <array>
+#include <cstdlib>
+
+#include "profile.hpp"
+
+namespace cameracli {
+namespace {
+constexpr uint32_t NO_COLOR = UINT32_MAX;
+
+const std::array<std::string, 256> &decimals() {
+    static const std::array<std::string, 256> table = [] {
+        std::array<std::string, 256> table;
+        for (int i = 0; i < 256; i++)
+            table[i] = std::to_string(i);
+        return table;
+    }();
+    return table;
+}
+} // namespace
+
+std::string_view colorDepthName(ColorDepth depth) {
+    switch (depth) {
+    case ColorDepth::Palette256:
+        return "256";
+    case ColorDepth::Palette16:
+        return "16";
+    default:
+        return "truecolor";
+    }
+}
+
+ColorDepth detectColorDepth() {
+    auto variable = [](const char *name) {
+        const char *value = std::getenv(name);
+        return std::string_view(value ? value : "");
+    };
+    auto colorTerm = variable("COLORTERM"), term = variable("TERM");
+    if (colorTerm == "truecolor" || colorTerm == "24bit" ||
+        term.find("-direct") != std::string_view::npos)
+        return ColorDepth::TrueColor;
+    if (term.find("256color") != std::string_view::npos)
+        return ColorDepth::Palette256;
+#ifdef _WIN32
+    // Windows Terminal and conhost set neither variable but do support true colour, so ftxui
+    // assumes it in that case as well.
+    if (term.empty() && colorTerm.empty())
+        return ColorDepth::TrueColor;
+#endif
+    return ColorDepth::Palette16;
+}
+
+void CellGrid::resize(CellMode mode, int width, int height) {
+    this->mode = mode;
+    colors = ColorDepth::TrueColor;
+    this->width = width;
+    this->height = height;
+    glyphs.resize((size_t)width * height);
+    foreground.resize((size_t)width * height);
+    background.resize((size_t)width * height);
+}
+
+void AnsiEncoder::encode(const CellGrid &grid) {
+    PROFILE_SCOPE(Encode);
+    if (grid.mode != previous_.mode || grid.colors != previous_.colors ||
+        grid.width != previous_.width || grid.height != previous_.height)
+        valid_ = false;
+
+    buffer_.clear();
+    rowOffsets_.resize(grid.height + 1);
+    for (int y = 0; y < grid.height; y++) {
+        rowOffsets_[y] = buffer_.size();
+        encodeRow(grid, y);
+    }
+    rowOffsets_[grid.height] = buffer_.size();
+
+    previous_.resize(grid.mode, grid.width, grid.height);
+    previous_.colors = grid.colors;
+    previous_.glyphs = grid.glyphs;
+    previous_.foreground = grid.foreground;
+    previous_.background = grid.background;
+    valid_ = true;
+}
+
+std::string_view AnsiEncoder::row(int y) const {
+    return std::string_view(buffer_).substr(rowOffsets_[y], rowOffsets_[y + 1] - rowOffsets_[y]);
+}
+
+void AnsiEncoder::encodeRow(const CellGrid &grid, int y) {
+    bool hasForeground = grid.mode != CellMode::Glyph;
+    bool hasBackground = grid.mode == CellMode::HalfBlock;
+    uint32_t foreground = NO_COLOR, background = NO_COLOR;
+    int skipped = 0;
+
+    for (int x = 0; x < grid.width; x++) {
+        size_t i = grid.index(x, y);
+        uint8_t glyph = grid.glyphs[i];
+        uint32_t cellForeground = hasForeground ? grid.foreground[i] : NO_COLOR;
+        uint32_t cellBackground = hasBackground ? grid.background[i] : NO_COLOR;
+
+        if (valid_ && (grid.mode == CellMode::HalfBlock || glyph == previous_.glyphs[i]) &&
+            (!hasForeground || cellForeground == previous_.foreground[i]) &&
+            (!hasBackground || cellBackground == previous_.background[i])) {
+            skipped++;
+            continue;
+        }
+        if (skipped) {
+            appendCursorForward(skipped);
+            skipped = 0;
+        }
+
+        // A half block whose halves match is just a space on that background, which saves the
+        // foreground code entirely.
+        bool solid = hasBackground && cellForeground == cellBackground;
+        bool setForeground = hasForeground && !solid && cellForeground != foreground;
+        bool setBackground = hasBackground && cellBackground != background;
+        if (setForeground || setBackground) {
+            buffer_ += "\x1b[";
+            if (setForeground) {
+                appendColor('3', cellForeground, grid.colors);
+                foreground = cellForeground;
+            }
+            if (setBackground) {
+                if (setForeground)
+                    buffer_ += ';';
+                appendColor('4', cellBackground, grid.colors);
+                background = cellBackground;
+            }
+            buffer_ += 'm';
+        }
+
+        if (grid.mode == CellMode::HalfBlock)
+            buffer_ += solid ? " " : "▀";
+        else
+            buffer_ += (char)glyph;
+    }
+
+    if (skipped)
+        appendCursorForward(skipped);
+    if (foreground != NO_COLOR || background != NO_COLOR)
+        buffer_ += "\x1b[m";
+}
+
+void AnsiEncoder::appendColor(char layer, uint32_t color, ColorDepth depth) {
+    auto &decimal = decimals();
+    if (depth == ColorDepth::Palette16) {
+        // 30-37 and 40-47 for the first eight, 90-97 and 100-107 for the bright ones.
+        if (color >= 8)
+            buffer_ += layer == '3' ? "9" : "10";
+        else
+            buffer_ += layer;
+        buffer_ += (char)('0' + color % 8);
+        return;
+    }
+    buffer_ += layer;
+    if (depth == ColorDepth::Palette256) {
+        buffer_ += "8;5;";
+        buffer_ += decimal[color];
+        return;
+    }
+    buffer_ += "8;2;";
+    buffer_ += decimal[color & 0xFF];
+    buffer_ += ';';
+    buffer_ += decimal[color >> 8 & 0xFF];
+    buffer_ += ';';
+    buffer_ += decimal[color >> 16 & 0xFF];
+}
+
+void AnsiEncoder::appendCursorForward(int columns) {
+    buffer_ += "\x1b[";
+    if (columns > 1)
+        buffer_ += std::to_string(columns);
+    buffer_ += 'C';
+}
+} // namespace cameracli
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cameracli {
+// Colours are packed as 0x00BBGGRR, which is what a little-endian 32-bit load of an RGB24 pixel
+// yields once the fourth byte is masked off.
+inline uint32_t packColor(uint8_t red, uint8_t green, uint8_t blue) {
+    return red | green << 8 | blue << 16;
+}
+
+// How a CellGrid's colours are stored and written: packed RGB, or an index into the xterm
+// 256-colour palette or the 16 basic colours, for terminals and multiplexers without 24-bit
+// colour or links where the shorter codes matter.
+enum class ColorDepth { TrueColor, Palette256, Palette16 };
+
+std::string_view colorDepthName(ColorDepth depth);
+// Guesses what the terminal supports from COLORTERM and TERM. On Windows, where terminals set
+// neither, true colour is assumed.
+ColorDepth detectColorDepth();
+
+enum class CellMode {
+    Glyph,        // glyph only, terminal default colours
+    ColoredGlyph, // glyph with a foreground colour
+    HalfBlock,    // "▀" with the top pixel as foreground and the bottom pixel as background
+};
+
+struct CellGrid {
+    CellMode mode = CellMode::HalfBlock;
+    ColorDepth colors = ColorDepth::TrueColor;
+    int width = 0, height = 0;
+    std::vector<uint8_t> glyphs;
+    std::vector<uint32_t> foreground, background;
+
+    // Also resets colors to TrueColor.
+    void resize(CellMode mode, int width, int height);
+    size_t index(int x, int y) const { return (size_t)y * width + x; }
+};
+
+// Encodes a cell grid as rows of SGR escape sequences. The previously encoded grid is kept so
+// that only cells whose glyph or colour changed are written; unchanged runs become cursor-forward
+// moves, so every row still advances the cursor by exactly grid.width columns.
+class AnsiEncoder {
+public:
+    void encode(const CellGrid &grid);
+    // Forget the previous grid, e.g. when the terminal was cleared or the image moved.
+    void invalidate() { valid_ = false; }
+    std::string_view row(int y) const;
+    size_t size() const { return buffer_.size(); }
+
+private:
+    void encodeRow(const CellGrid &grid, int y);
+    void appendColor(char layer, uint32_t color, ColorDepth depth);
+    void appendCursorForward(int columns);
+
+    std::string buffer_;
+    std::vector<size_t> rowOffsets_;
+    CellGrid previous_;
+    bool valid_ = false;
+};
+} // namespace cameracli
@@ -0,0 +1,143 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "pipeline.hpp"
+#include "source.hpp"
+
+#define BENCH_WARMUP_FRAMES 10
+#define BENCH_READ_TIMEOUT 3000
+
+namespace cameracli {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Stage {
+    const char *name;
+    std::vector<double> samples; // microseconds
+
+    double percentile(double fraction) const {
+        return samples[std::min(samples.size() - 1, (size_t)(samples.size() * fraction))];
+    }
+    double mean() const {
+        double sum = 0;
+        for (double sample : samples)
+            sum += sample;
+        return sum / samples.size();
+    }
+};
+
+double microseconds(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+std::string jsonString(std::string_view text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if ((unsigned char)c < 0x20)
+            escaped += fmt::format("\\u{:04x}", c);
+        else
+            escaped += c;
+    }
+    return escaped + '"';
+}
+} // namespace
+
+void runBenchmark(const Options &options) {
+    auto source = makeFrameSource(options.source, options.pixelFormat, options.sourceWidth,
+                                  options.sourceHeight, 0);
+    if (!source->open())
+        throw std::runtime_error("couldn't open the capture device");
+
+    FramePipeline pipeline;
+    AnsiEncoder encoder;
+    CapturedFrame frame;
+    std::vector<Stage> stages = {{"capture"}, {"resize"}, {"convert"}, {"encode"}};
+    for (auto &stage : stages)
+        stage.samples.reserve(options.benchFrames);
+    size_t totalBytes = 0, maximumBytes = 0;
+
+    auto read = [&] {
+        if (!source->read(frame, BENCH_READ_TIMEOUT))
+            throw std::runtime_error("couldn't capture camera");
+    };
+    for (int i = 0; i < BENCH_WARMUP_FRAMES; i++) {
+        read();
+        encoder.encode(pipeline.process(frame.view, options.columns, options.rows,
+                                        options.frameOptions));
+    }
+
+    auto start = Clock::now();
+    for (int i = 0; i < options.benchFrames; i++) {
+        auto captureStart = Clock::now();
+        read();
+        auto resizeStart = Clock::now();
+        pipeline.resize(frame.view, options.columns, options.rows, options.frameOptions);
+        auto convertStart = Clock::now();
+        auto &grid = pipeline.convert(options.frameOptions);
+        auto encodeStart = Clock::now();
+        encoder.encode(grid);
+        auto end = Clock::now();
+
+        stages[0].samples.push_back(microseconds(captureStart, resizeStart));
+        stages[1].samples.push_back(microseconds(resizeStart, convertStart));
+        stages[2].samples.push_back(microseconds(convertStart, encodeStart));
+        stages[3].samples.push_back(microseconds(encodeStart, end));
+        totalBytes += encoder.size();
+        maximumBytes = std::max(maximumBytes, encoder.size());
+    }
+    double seconds = microseconds(start, Clock::now()) / 1e6;
+
+    for (auto &stage : stages)
+        std::sort(stage.samples.begin(), stage.samples.end());
+    double framesPerSecond = options.benchFrames / seconds;
+    double bytesPerFrame = (double)totalBytes / options.benchFrames;
+    auto mode = options.frameOptions.ascii ? "ascii" : "halfblock";
+    auto kernel = kernelName(bestKernel());
+    auto pixelFormat = frameFormatName(frame.view.format);
+
+    auto colors = colorDepthName(options.frameOptions.colors);
+    fmt::print("{} {} frames of {} at {}x{} into {}x{} cells ({}{}, {} colour{}, {} kernel)\n",
+               options.benchFrames, pixelFormat, options.source, frame.view.width,
+               frame.view.height, options.columns, options.rows, mode,
+               options.frameOptions.grayscale ? ", grayscale" : "", colors,
+               options.frameOptions.dither ? ", dithered" : "", kernel);
+    fmt::print("{:>10} {:>10} {:>10} {:>10}\n", "stage", "p50 us", "p99 us", "mean us");
+    for (auto &stage : stages)
+        fmt::print("{:>10} {:>10.1f} {:>10.1f} {:>10.1f}\n", stage.name, stage.percentile(0.5),
+                   stage.percentile(0.99), stage.mean());
+    fmt::print("{:.1f} frames/s, {:.0f} bytes/frame on average, {} at most\n", framesPerSecond,
+               bytesPerFrame, maximumBytes);
+
+    if (options.json.empty())
+        return;
+    std::ofstream json(options.json);
+    if (!json)
+        throw std::runtime_error("couldn't open " + options.json);
+    json << fmt::format(
+        "{{\n  \"source\": {},\n  \"pixelFormat\": \"{}\",\n  \"sourceWidth\": {},\n"
+        "  \"sourceHeight\": {},\n  \"columns\": {},\n  \"rows\": {},\n  \"mode\": \"{}\",\n"
+        "  \"grayscale\": {},\n  \"colors\": \"{}\",\n  \"dither\": {},\n"
+        "  \"kernel\": \"{}\",\n  \"frames\": {},\n"
+        "  \"framesPerSecond\": {:.3f},\n"
+        "  \"bytesPerFrame\": {{\"mean\": {:.1f}, \"max\": {}}},\n  \"stages\": {{",
+        jsonString(options.source), pixelFormat, frame.view.width, frame.view.height,
+        options.columns, options.rows, mode, options.frameOptions.grayscale, colors,
+        options.frameOptions.dither, kernel, options.benchFrames, framesPerSecond, bytesPerFrame,
+        maximumBytes);
+    for (size_t i = 0; i < stages.size(); i++)
+        json << fmt::format(
+            "{}\n    \"{}\": {{\"p50Us\": {:.3f}, \"p99Us\": {:.3f}, \"meanUs\": {:.3f}}}",
+            i ? "," : "", stages[i].name, stages[i].percentile(0.5), stages[i].percentile(0.99),
+            stages[i].mean());
+    json << "\n  }\n}\n";
+}
+} // namespace cameracli
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "options.hpp"
+
+namespace cameracli {
+// Pushes options.benchFrames frames from options.source through capture, resize, conversion and
+// encoding without a terminal, then reports throughput, per-stage latency and output size.
+void runBenchmark(const Options &options);
+} // namespace cameracli
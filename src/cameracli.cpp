@@ -1,5 +1,6 @@
+#include <array>
 #include <chrono>
-using namespace std::chrono_literals;
+#include <exception>
 #include <iostream>
 #include <locale>
 #include <memory>
@@ -10,191 +11,221 @@ using namespace std::chrono_literals;
 #include <ftxui/component/screen_interactive.hpp>
 #include <ftxui/dom/canvas.hpp>
 #include <ftxui/dom/elements.hpp>
+#include <ftxui/dom/node.hpp>
 #include <ftxui/screen/box.hpp>
+#include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
-#define STB_IMAGE_RESIZE2_IMPLEMENTATION
-#include <stb/stb_image_resize2.h>
 
-#define CCAP_GRAB_MAXIMUM_WAIT_TIME 3000
+#include "ansi.hpp"
+#include "bench.hpp"
+#include "capture.hpp"
+#include "client.hpp"
+#include "options.hpp"
+#include "pacing.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
+#include "server.hpp"
 
-namespace cameracli {
-class IntervalTimer {
-public:
-    IntervalTimer(ftxui::ScreenInteractive &screen, std::chrono::milliseconds interval)
-        : running_(true)
-        , thread_([&, interval] {
-            while (running_) {
-                std::this_thread::sleep_for(interval);
-                screen.PostEvent(ftxui::Event::Custom);
-            }
-        }) {}
-
-    ~IntervalTimer() {
-        running_ = false;
-        thread_.join();
-    }
-
-private:
-    std::atomic<bool> running_;
-    std::thread thread_;
-};
 
-struct Pixel {
-    uint8_t red;
-    uint8_t green;
-    uint8_t blue;
-};
+// Seconds over which the HUD's frame rates are averaged, so that they don't flicker.
+#define PERFORMANCE_HUD_INTERVAL 0.5
 
-class Frame {
-public:
-    std::vector<Pixel> pixels;
-    int height, width;
-    Frame(std::vector<Pixel> pixels, int width, int height);
-    Frame(std::shared_ptr<ccap::VideoFrame> videoFrame);
-    Pixel at(int x, int y);
-    Frame copy();
-    void flip(bool flipX, bool flipY);
-    void resize(int width, int height);
-    void setPixel(Pixel pixel, int x, int y);
-};
-
-Frame::Frame(std::vector<Pixel> pixels, int width, int height) {
-    this->pixels = pixels;
-    this->width = width;
-    this->height = height;
+namespace cameracli {
+ftxui::Color cellColor(uint32_t color, ColorDepth depth) {
+    if (depth == ColorDepth::Palette256)
+        return ftxui::Color((ftxui::Color::Palette256)color);
+    if (depth == ColorDepth::Palette16)
+        return ftxui::Color((ftxui::Color::Palette16)color);
+    return ftxui::Color::RGB(color & 0xFF, color >> 8 & 0xFF, color >> 16 & 0xFF);
 }
 
-Frame::Frame(std::shared_ptr<ccap::VideoFrame> videoFrame) {
-    height = videoFrame->height;
-    width = videoFrame->width;
-    pixels = std::vector<Pixel>(width * height);
-    memcpy(pixels.data(), videoFrame->data[0], width * height * 3);
+ftxui::Element renderCellGrid(const CellGrid &grid) {
+    ftxui::Elements rows;
+    for (int y = 0; y < grid.height; y++) {
+        ftxui::Elements row;
+        for (int x = 0; x < grid.width; x++) {
+            auto i = grid.index(x, y);
+            switch (grid.mode) {
+            case CellMode::Glyph:
+                row.push_back(ftxui::text(std::string(1, grid.glyphs[i])));
+                break;
+            case CellMode::ColoredGlyph:
+                row.push_back(ftxui::text(std::string(1, grid.glyphs[i])) |
+                              ftxui::color(cellColor(grid.foreground[i], grid.colors)));
+                break;
+            case CellMode::HalfBlock:
+                row.push_back(ftxui::text("▀") |
+                              ftxui::color(cellColor(grid.foreground[i], grid.colors)) |
+                              ftxui::bgcolor(cellColor(grid.background[i], grid.colors)));
+                break;
+            }
+        }
+        rows.push_back(ftxui::hbox(row));
+    }
+    return ftxui::vbox(rows);
 }
 
-Pixel Frame::at(int x, int y) { return pixels.at(y * width + x); }
-
-Frame captureCamera(ccap::Provider &cameraProvider) {
-    auto videoFrame = cameraProvider.grab(CCAP_GRAB_MAXIMUM_WAIT_TIME);
+// State kept across frames by the direct output backend.
+struct DirectOutput {
+    bool enabled = true;
+    AnsiEncoder encoder;
+    ftxui::Box box;
+    int screenWidth = 0, screenHeight = 0;
+};
 
-    if (!videoFrame)
-        throw std::runtime_error("couldn't capture camera");
+// Writes the encoded rows straight into the screen instead of building one element per cell.
+// Each row's escape sequences go into the character of its first cell and the remaining cells
+// hold a NUL, which ftxui prints verbatim and terminals ignore; an empty character would be
+// printed as a space and overwrite the cells the encoder deliberately skipped.
+class DirectFrameNode : public ftxui::Node {
+public:
+    DirectFrameNode(DirectOutput &output, const CellGrid &grid) : output_(output), grid_(grid) {}
 
-    return Frame(videoFrame);
-}
+    void ComputeRequirement() override {
+        requirement_.min_x = grid_.width;
+        requirement_.min_y = grid_.height;
+    }
 
-Frame Frame::copy() {
-    std::vector<Pixel> frameDataCopy(width * height);
-    memcpy(frameDataCopy.data(), pixels.data(), width * height * 3);
-    return Frame(frameDataCopy, width, height);
-}
+    void Render(ftxui::Screen &screen) override {
+        auto &grid = grid_;
+        if (box_.x_min != output_.box.x_min || box_.y_min != output_.box.y_min ||
+            box_.x_max != output_.box.x_max || box_.y_max != output_.box.y_max ||
+            screen.dimx() != output_.screenWidth || screen.dimy() != output_.screenHeight)
+            output_.encoder.invalidate();
+        output_.box = box_;
+        output_.screenWidth = screen.dimx();
+        output_.screenHeight = screen.dimy();
+
+        if (box_.x_min < 0 || box_.y_min < 0 || box_.x_min + grid.width > screen.dimx() ||
+            box_.y_min + grid.height > screen.dimy()) {
+            output_.encoder.invalidate();
+            return;
+        }
 
-void Frame::flip(bool flipX, bool flipY) {
-    if (!flipX && !flipY)
-        return;
-    auto frameCopy = copy();
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int otherX = flipX ? width - x - 1 : x;
-            int otherY = flipY ? height - y - 1 : y;
-            setPixel(frameCopy.at(otherX, otherY), x, y);
+        output_.encoder.encode(grid);
+        static const std::string nul(1, '\0');
+        for (int y = 0; y < grid.height; y++) {
+            screen.PixelAt(box_.x_min, box_.y_min + y).character = output_.encoder.row(y);
+            for (int x = 1; x < grid.width; x++)
+                screen.PixelAt(box_.x_min + x, box_.y_min + y).character = nul;
         }
     }
-}
-
-void Frame::resize(int width, int height) {
-    std::vector<Pixel> resizedFrame(width * height);
-    stbir_resize_uint8_srgb((unsigned char *)pixels.data(), this->width, this->height, 0,
-                            (unsigned char *)resizedFrame.data(), width, height, 0, STBIR_RGB);
-    pixels = resizedFrame;
-    this->width = width;
-    this->height = height;
-}
 
-void Frame::setPixel(Pixel pixel, int x, int y) { pixels[y * width + x] = pixel; }
+private:
+    DirectOutput &output_;
+    const CellGrid &grid_;
+};
 
-struct FrameOptions {
-    bool ascii, flipX, flipY, grayscale;
+#ifdef CAMERACLI_PROFILING
+struct PerformanceHud {
+    bool enabled = false;
+    std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+    uint64_t capturedFrames = 0, drawnFrames = 0;
+    double captureRate = 0, drawRate = 0;
 };
 
-std::string pixelToASCII(Pixel pixel) {
-    static std::string grayscaleCharset =
-        "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'.          ";
-    int avg = (pixel.red + pixel.green + pixel.blue) / 3;
-    return std::string({grayscaleCharset.at(78 - avg * 78 / 255)});
-}
+ftxui::Element renderPerformanceHud(PerformanceHud &hud) {
+    auto &profile = profiler();
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - hud.since).count();
+    if (elapsed >= PERFORMANCE_HUD_INTERVAL) {
+        auto capturedFrames = profile.counter(ProfileCounter::CapturedFrames);
+        auto drawnFrames = profile.counter(ProfileCounter::DrawnFrames);
+        hud.captureRate = (capturedFrames - hud.capturedFrames) / elapsed;
+        hud.drawRate = (drawnFrames - hud.drawnFrames) / elapsed;
+        hud.capturedFrames = capturedFrames;
+        hud.drawnFrames = drawnFrames;
+        hud.since = now;
+    }
 
-ftxui::Element renderFrame(ccap::Provider &cameraProvider, int width, int height,
-                           FrameOptions frameOptions) {
-    auto frame = captureCamera(cameraProvider);
-    frame.resize(width, frameOptions.ascii ? height : height * 2);
-    frame.flip(!frameOptions.flipX, frameOptions.flipY);
+    ftxui::Elements lines = {
+        ftxui::text(fmt::format("capture {:8.1f} fps", hud.captureRate)),
+        ftxui::text(fmt::format("render  {:8.1f} fps", hud.drawRate)),
+        ftxui::text(fmt::format("dropped {:8} frames",
+                                profile.counter(ProfileCounter::DroppedFrames))),
+        ftxui::text(fmt::format("{:<8}{:>8}{:>8}", "", "p50", "p99")) | ftxui::bold,
+    };
+    for (int stage = 0; stage < (int)ProfileStage::Count; stage++) {
+        auto times = profile.stage((ProfileStage)stage);
+        lines.push_back(ftxui::text(fmt::format("{:<8}{:>6}us{:>6}us",
+                                                profileStageName((ProfileStage)stage), times.p50,
+                                                times.p99)));
+    }
+    // Everything written to the terminal per frame, control panel included.
+    auto bytes = profile.bytes();
+    if (bytes.count)
+        lines.push_back(ftxui::text(fmt::format("{:<8}{:>7}B{:>7}B", "written", bytes.p50,
+                                                bytes.p99)));
+    return ftxui::vbox(lines);
+}
+#endif
+
+ftxui::Element renderFrame(const FrameView &source, int width, int height,
+                           FrameOptions frameOptions, int reduction, FramePipeline &pipeline,
+                           DirectOutput &directOutput) {
+    if (!source.data[0] || width <= 0 || height <= 0) {
+        directOutput.encoder.invalidate();
+        return ftxui::text("Waiting for camera...") | ftxui::center | ftxui::borderRounded;
+    }
 
-    ftxui::Elements rows;
+    auto &grid = pipeline.process(source, width, height, frameOptions, reduction);
 
-    if (frameOptions.ascii) {
-        for (int y = 0; y < frame.height; y++) {
-            ftxui::Elements row;
-            for (int x = 0; x < frame.width; x++) {
-                auto pixel = frame.at(x, y);
-                if (frameOptions.grayscale)
-                    row.push_back(ftxui::text(pixelToASCII(pixel)));
-                else {
-                    auto color = ftxui::Color::RGB(pixel.red, pixel.green, pixel.blue);
-                    row.push_back(ftxui::text("$") | ftxui::color(color));
-                }
-            }
-            rows.push_back(ftxui::hbox(row));
-        }
-    } else {
-        for (int y = 0; y < frame.height; y += 2) {
-            ftxui::Elements row;
-            for (int x = 0; x < frame.width; x++) {
-                auto topPixel = frame.at(x, y);
-                auto bottomPixel = frame.at(x, y + 1);
-                uint8_t topRed = topPixel.red, topGreen = topPixel.green, topBlue = topPixel.blue;
-                if (frameOptions.grayscale) {
-                    uint8_t avg = (topRed + topGreen + topBlue) / 3;
-                    topRed = avg;
-                    topGreen = avg;
-                    topBlue = avg;
-                }
-                ftxui::Color top = ftxui::Color::RGB(topRed, topGreen, topBlue);
-
-                uint8_t bottomRed = bottomPixel.red, bottomGreen = bottomPixel.green,
-                        bottomBlue = bottomPixel.blue;
-                if (frameOptions.grayscale) {
-                    uint8_t avg = (bottomRed + bottomGreen + bottomBlue) / 3;
-                    bottomRed = avg;
-                    bottomGreen = avg;
-                    bottomBlue = avg;
-                }
-                ftxui::Color bottom = ftxui::Color::RGB(bottomRed, bottomGreen, bottomBlue);
-                row.push_back(ftxui::text("▀") | ftxui::color(top) | ftxui::bgcolor(bottom));
-            }
-            rows.push_back(ftxui::hbox(row));
-        }
+    if (!directOutput.enabled) {
+        directOutput.encoder.invalidate();
+        return renderCellGrid(grid) | ftxui::borderRounded;
     }
 
-    return ftxui::vbox(rows) | ftxui::borderRounded;
+    return std::make_shared<DirectFrameNode>(directOutput, grid) | ftxui::borderRounded;
 }
 
 void run(int argc, char const *argv[]) {
     if (!setlocale(LC_ALL, ""))
         throw std::runtime_error("failed to set locale");
 
-    auto screen = ftxui::ScreenInteractive::Fullscreen();
-    ccap::Provider cameraProvider;
-
-    cameraProvider.set(ccap::PropertyName::PixelFormatInternal, ccap::PixelFormat::RGB24);
-    cameraProvider.set(ccap::PropertyName::PixelFormatOutput, ccap::PixelFormat::RGB24);
+    auto options = parseOptions(argc, argv);
+    if (options.help) {
+        printUsage();
+        return;
+    }
+#ifdef CAMERACLI_PROFILING
+    TraceSession trace(options.trace);
+    // ftxui writes each frame to std::cout; counting it there covers both backends.
+    CountingOutput terminalOutput(std::cout);
+#else
+    if (!options.trace.empty())
+        throw std::runtime_error("--trace needs a build with CAMERACLI_PROFILING enabled");
+#endif
 
     ccap::setErrorCallback([](ccap::ErrorCode errorCode, std::string_view errorDescription) {
         spdlog::error(errorDescription);
     });
 
-    IntervalTimer timer(screen, 1ms);
+    if (options.bench) {
+        runBenchmark(options);
+        return;
+    }
+    if (!options.serve.empty()) {
+        runServer(options);
+        return;
+    }
+    if (!options.connect.empty()) {
+        runClient(options);
+        return;
+    }
+
+    auto screen = ftxui::ScreenInteractive::Fullscreen();
 
-    struct FrameOptions frameOptions{};
+    // Redraws are driven by new frames; ftxui redraws on its own for input.
+    FrameScheduler scheduler(options.maximumFrameRate,
+                             [&] { screen.PostEvent(ftxui::Event::Custom); });
+    CaptureThread capture(makeFrameSource(options.source, options.pixelFormat,
+                                          options.sourceWidth, options.sourceHeight,
+                                          GENERATED_FRAME_RATE),
+                          [&] { scheduler.frameArrived(); });
+
+    struct FrameOptions frameOptions = options.frameOptions;
+    FramePipeline pipeline;
+    DirectOutput directOutput;
 
     std::string asciiCheckboxLabel = "ASCII";
     auto asciiCheckbox = ftxui::Checkbox(&asciiCheckboxLabel, &frameOptions.ascii);
@@ -208,11 +239,31 @@ void run(int argc, char const *argv[]) {
     std::string grayscaleCheckboxLabel = "Grayscale";
     auto grayscaleCheckbox = ftxui::Checkbox(&grayscaleCheckboxLabel, &frameOptions.grayscale);
 
+    std::string directOutputCheckboxLabel = "Direct output";
+    auto directOutputCheckbox =
+        ftxui::Checkbox(&directOutputCheckboxLabel, &directOutput.enabled);
+
     auto checkboxListLayout = ftxui::Container::Vertical(
-        {asciiCheckbox, flipXCheckbox, flipYCheckbox, grayscaleCheckbox});
+        {asciiCheckbox, flipXCheckbox, flipYCheckbox, grayscaleCheckbox, directOutputCheckbox});
+#ifdef CAMERACLI_PROFILING
+    PerformanceHud performanceHud;
+    std::string performanceHudCheckboxLabel = "Performance HUD";
+    auto performanceHudCheckbox =
+        ftxui::Checkbox(&performanceHudCheckboxLabel, &performanceHud.enabled);
+    checkboxListLayout->Add(performanceHudCheckbox);
+#endif
     auto checkboxListRenderer = ftxui::Renderer(checkboxListLayout, [&] {
-        return ftxui::vbox({asciiCheckbox->Render(), flipXCheckbox->Render(),
-                            flipYCheckbox->Render(), grayscaleCheckbox->Render()});
+        ftxui::Elements checkboxes = {asciiCheckbox->Render(), flipXCheckbox->Render(),
+                                      flipYCheckbox->Render(), grayscaleCheckbox->Render(),
+                                      directOutputCheckbox->Render()};
+#ifdef CAMERACLI_PROFILING
+        checkboxes.push_back(performanceHudCheckbox->Render());
+        if (performanceHud.enabled) {
+            checkboxes.push_back(ftxui::separator());
+            checkboxes.push_back(renderPerformanceHud(performanceHud));
+        }
+#endif
+        return ftxui::vbox(checkboxes);
     });
 
     std::string quitButtonLabel = "Quit";
@@ -228,7 +279,14 @@ void run(int argc, char const *argv[]) {
 
     int frameWidth = 0, frameHeight = 0;
     auto frameRenderer = ftxui::Renderer([&] {
-        return renderFrame(cameraProvider, frameWidth, frameHeight, frameOptions) |
+        // Posted tasks run after the frame has been written out, so this times the whole draw.
+        scheduler.frameStarted();
+        screen.Post([&] {
+            PROFILE_BYTES(terminalOutput.take());
+            scheduler.frameFinished();
+        });
+        return renderFrame(capture.latest(), frameWidth, frameHeight, frameOptions,
+                           scheduler.reduction(), pipeline, directOutput) |
                ftxui::flex_grow;
     });
 
@@ -248,7 +306,7 @@ void run(int argc, char const *argv[]) {
     });
     quitButton->Render();
 
-    if (cameraProvider.open())
+    if (capture.open())
         screen.Loop(component);
     else
         throw std::runtime_error("couldn't open the capture device");
@@ -0,0 +1,66 @@
+#include "capture.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "profile.hpp"
+
+#define CCAP_GRAB_MAXIMUM_WAIT_TIME 3000
+#define CCAP_GRAB_POLL_TIME 100
+
+namespace cameracli {
+CaptureThread::CaptureThread(std::unique_ptr<FrameSource> source, std::function<void()> onFrame)
+    : source_(std::move(source))
+    , onFrame_(std::move(onFrame)) {}
+
+CaptureThread::~CaptureThread() {
+    running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+bool CaptureThread::open() {
+    if (!source_->open())
+        return false;
+    running_ = true;
+    thread_ = std::thread([this] { capture(); });
+    return true;
+}
+
+void CaptureThread::capture() {
+    // Grab in short slices so the destructor never waits on a stalled sensor for the whole
+    // timeout, but still give up once the camera has been silent for CCAP_GRAB_MAXIMUM_WAIT_TIME.
+    int waited = 0;
+    while (running_) {
+        [[maybe_unused]] auto started = std::chrono::steady_clock::now();
+        try {
+            if (!source_->read(frames_.back(), CCAP_GRAB_POLL_TIME)) {
+                waited += CCAP_GRAB_POLL_TIME;
+                if (waited < CCAP_GRAB_MAXIMUM_WAIT_TIME)
+                    continue;
+                throw std::runtime_error("couldn't capture camera");
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+            failed_.store(true, std::memory_order_release);
+            if (onFrame_)
+                onFrame_();
+            return;
+        }
+        waited = 0;
+        PROFILE_SPAN(Capture, started, std::chrono::steady_clock::now());
+        PROFILE_COUNT(CapturedFrames);
+        if (frames_.publish())
+            PROFILE_COUNT(DroppedFrames);
+        if (onFrame_)
+            onFrame_();
+    }
+}
+
+const FrameView &CaptureThread::latest() {
+    if (failed_.load(std::memory_order_acquire))
+        std::rethrow_exception(error_);
+    frames_.update();
+    return frames_.front().view;
+}
+} // namespace cameracli
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "source.hpp"
+
+namespace cameracli {
+// Single-producer/single-consumer slot exchange. The producer fills back() and publishes it, the
+// consumer picks up the newest published slot with update() and reads it through front(). Neither
+// side ever waits for the other; a slot published before the consumer got to it is overwritten,
+// in which case publish() returns true.
+template <typename T> class TripleBuffer {
+public:
+    T &back() { return slots_[back_]; }
+
+    bool publish() {
+        uint8_t previous = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+        back_ = previous & INDEX;
+        return previous & FRESH;
+    }
+
+    bool update() {
+        if (!(middle_.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    T &front() { return slots_[front_]; }
+
+private:
+    static constexpr uint8_t INDEX = 0b011;
+    static constexpr uint8_t FRESH = 0b100;
+
+    std::array<T, 3> slots_;
+    std::atomic<uint8_t> middle_ = 1;
+    uint8_t back_ = 0, front_ = 2;
+};
+
+// Reads a frame source on its own thread so that a stalled camera never blocks the reader.
+// onFrame, if given, is called on the capture thread after every published frame, and once
+// more if capturing fails so that the error gets noticed.
+class CaptureThread {
+public:
+    explicit CaptureThread(std::unique_ptr<FrameSource> source,
+                           std::function<void()> onFrame = {});
+    ~CaptureThread();
+    bool open();
+    // The newest captured frame, or an empty view before the first one arrived. Rethrows the
+    // error that stopped capturing, if any.
+    const FrameView &latest();
+
+private:
+    void capture();
+
+    std::unique_ptr<FrameSource> source_;
+    std::function<void()> onFrame_;
+    TripleBuffer<CapturedFrame> frames_;
+    std::atomic<bool> running_ = false;
+    std::atomic<bool> failed_ = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
+} // namespace cameracli
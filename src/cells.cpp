@@ -0,0 +1,373 @@
+#include "cells.hpp"
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CAMERACLI_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// How far ordered dithering moves a channel at most, roughly the gap between neighbouring
+// palette levels.
+#define DITHER_SPREAD_256 40
+#define DITHER_SPREAD_16 96
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CAMERACLI_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CAMERACLI_TARGET(isa)
+#endif
+
+namespace cameracli {
+namespace {
+// Converts one row of RGB24 pixels into packed colours and, when lumas isn't null, their
+// channel averages. A reversed row is written back to front.
+using ConvertRow = void (*)(const uint8_t *source, int width, bool reverse, bool grayscale,
+                            uint32_t *colors, uint8_t *lumas);
+
+// (r + g + b) / 3 as a 16-bit high multiply; exact for every sum of three channels.
+constexpr uint32_t THIRD = 21846;
+
+const std::array<uint8_t, 256> &glyphTable() {
+    static const std::array<uint8_t, 256> table = [] {
+        static const std::string_view grayscaleCharset =
+            "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'.          ";
+        std::array<uint8_t, 256> table;
+        for (int luma = 0; luma < 256; luma++)
+            table[luma] = grayscaleCharset[78 - luma * 78 / 255];
+        return table;
+    }();
+    return table;
+}
+
+// Studio-swing luma stretched to 0-255, or left alone when it's already full range.
+const std::array<uint8_t, 256> &lumaTable(bool fullRange) {
+    static const auto table = [] {
+        std::array<std::array<uint8_t, 256>, 2> table;
+        for (int luma = 0; luma < 256; luma++) {
+            int level = ((luma - 16) * 255 + 109) / 219;
+            table[0][luma] = level < 0 ? 0 : level > 255 ? 255 : level;
+            table[1][luma] = luma;
+        }
+        return table;
+    }();
+    return table[fullRange];
+}
+
+void convertPixels(const uint8_t *source, int from, int width, bool reverse, bool grayscale,
+                   uint32_t *colors, uint8_t *lumas) {
+    for (int x = from; x < width; x++) {
+        const uint8_t *pixel = source + x * 3;
+        uint32_t color = packColor(pixel[0], pixel[1], pixel[2]);
+        uint32_t luma = (pixel[0] + pixel[1] + pixel[2]) * THIRD >> 16;
+        int target = reverse ? width - 1 - x : x;
+        colors[target] = grayscale ? luma * 0x010101 : color;
+        if (lumas)
+            lumas[target] = luma;
+    }
+}
+
+void convertRowScalar(const uint8_t *source, int width, bool reverse, bool grayscale,
+                      uint32_t *colors, uint8_t *lumas) {
+    convertPixels(source, 0, width, reverse, grayscale, colors, lumas);
+}
+
+#ifdef CAMERACLI_X86_64
+bool cpuHasAvx2() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = info[2] & 1 << 27, avx = info[2] & 1 << 28;
+    if (!osxsave || !avx || (_xgetbv(0) & 0b110) != 0b110)
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & 1 << 5;
+#endif
+}
+
+// Four pixels per iteration. SSE2 has no byte shuffle, so the pixels are lined up by combining
+// the same load shifted by 0, 3, 6 and 9 bytes.
+CAMERACLI_TARGET("sse2")
+void convertRowSse2(const uint8_t *source, int width, bool reverse, bool grayscale,
+                    uint32_t *colors, uint8_t *lumas) {
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i channelMask = _mm_set1_epi32(0xFF);
+    const __m128i third = _mm_set1_epi32(THIRD);
+
+    int x = 0;
+    // Each load reads 16 bytes for 12 bytes of pixels; stay inside the row.
+    for (; x + 6 <= width; x += 4) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(source + x * 3));
+        __m128i low = _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3));
+        __m128i high = _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6), _mm_srli_si128(bytes, 9));
+        __m128i color = _mm_and_si128(_mm_unpacklo_epi64(low, high), rgbMask);
+
+        __m128i sum = _mm_add_epi32(
+            _mm_and_si128(color, channelMask),
+            _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(color, 8), channelMask),
+                          _mm_srli_epi32(color, 16)));
+        __m128i luma = _mm_mulhi_epu16(sum, third);
+        if (grayscale)
+            color = _mm_or_si128(luma,
+                                 _mm_or_si128(_mm_slli_epi32(luma, 8), _mm_slli_epi32(luma, 16)));
+
+        int target = x;
+        if (reverse) {
+            color = _mm_shuffle_epi32(color, _MM_SHUFFLE(0, 1, 2, 3));
+            luma = _mm_shuffle_epi32(luma, _MM_SHUFFLE(0, 1, 2, 3));
+            target = width - x - 4;
+        }
+        _mm_storeu_si128((__m128i *)(colors + target), color);
+        if (lumas) {
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(luma, luma), luma);
+            int32_t bytes = _mm_cvtsi128_si32(packed);
+            memcpy(lumas + target, &bytes, sizeof(bytes));
+        }
+    }
+    convertPixels(source, x, width, reverse, grayscale, colors, lumas);
+}
+
+// Eight pixels per iteration: spread the 24 bytes over both 128-bit lanes, then shuffle each
+// pixel into its own 32-bit element.
+CAMERACLI_TARGET("avx2")
+void convertRowAvx2(const uint8_t *source, int width, bool reverse, bool grayscale,
+                    uint32_t *colors, uint8_t *lumas) {
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i gather = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i reversed = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i lumaBytes =
+        _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8,
+                         12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i channelMask = _mm256_set1_epi32(0xFF);
+    const __m256i third = _mm256_set1_epi32(THIRD);
+
+    int x = 0;
+    // Each load reads 32 bytes for 24 bytes of pixels; stay inside the row.
+    for (; x + 11 <= width; x += 8) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(source + x * 3));
+        __m256i color = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(bytes, spread), gather);
+
+        __m256i sum = _mm256_add_epi32(
+            _mm256_and_si256(color, channelMask),
+            _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(color, 8), channelMask),
+                             _mm256_srli_epi32(color, 16)));
+        __m256i luma = _mm256_mulhi_epu16(sum, third);
+        if (grayscale)
+            color = _mm256_or_si256(
+                luma, _mm256_or_si256(_mm256_slli_epi32(luma, 8), _mm256_slli_epi32(luma, 16)));
+
+        int target = x;
+        if (reverse) {
+            color = _mm256_permutevar8x32_epi32(color, reversed);
+            luma = _mm256_permutevar8x32_epi32(luma, reversed);
+            target = width - x - 8;
+        }
+        _mm256_storeu_si256((__m256i *)(colors + target), color);
+        if (lumas) {
+            __m256i packed = _mm256_shuffle_epi8(luma, lumaBytes);
+            _mm_storel_epi64((__m128i *)(lumas + target),
+                             _mm_unpacklo_epi32(_mm256_castsi256_si128(packed),
+                                                _mm256_extracti128_si256(packed, 1)));
+        }
+    }
+    convertPixels(source, x, width, reverse, grayscale, colors, lumas);
+}
+#endif
+
+// xterm's default basic colours; the real ones vary between terminals.
+constexpr std::array<uint32_t, 16> BASIC_PALETTE = {
+    0x000000, 0x0000CD, 0x00CD00, 0x00CDCD, 0xEE0000, 0xCD00CD, 0xCDCD00, 0xE5E5E5,
+    0x7F7F7F, 0x0000FF, 0x00FF00, 0x00FFFF, 0xFF5C5C, 0xFF00FF, 0xFFFF00, 0xFFFFFF,
+};
+
+// Entry index of the palette as a packed colour. The 256-colour palette leaves the basic
+// colours alone, since terminals redefine them, and picks from the 6x6x6 cube and gray ramp.
+uint32_t paletteColor(ColorDepth depth, int index) {
+    if (depth == ColorDepth::Palette16)
+        return BASIC_PALETTE[index];
+    if (index >= 232)
+        return (8 + (index - 232) * 10) * 0x010101;
+    static const uint8_t levels[] = {0, 95, 135, 175, 215, 255};
+    int cube = index - 16;
+    return packColor(levels[cube / 36], levels[cube / 6 % 6], levels[cube % 6]);
+}
+
+// The nearest palette index for every colour at 5 bits per channel, so quantizing a cell is one
+// lookup rather than a search.
+std::vector<uint8_t> buildQuantizationTable(ColorDepth depth) {
+    int first = depth == ColorDepth::Palette16 ? 0 : 16;
+    int count = depth == ColorDepth::Palette16 ? 16 : 256;
+    std::vector<uint8_t> table(32 * 32 * 32);
+    for (int i = 0; i < 32 * 32 * 32; i++) {
+        int red = (i & 31) * 8 + 4, green = (i >> 5 & 31) * 8 + 4, blue = (i >> 10) * 8 + 4;
+        int nearest = first, nearestDistance = INT32_MAX;
+        for (int index = first; index < count; index++) {
+            uint32_t color = paletteColor(depth, index);
+            int dr = red - (int)(color & 0xFF), dg = green - (int)(color >> 8 & 0xFF),
+                db = blue - (int)(color >> 16);
+            // Weighted for the eye's sensitivity to green.
+            int distance = 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+            if (distance < nearestDistance) {
+                nearest = index;
+                nearestDistance = distance;
+            }
+        }
+        table[i] = nearest;
+    }
+    return table;
+}
+
+const std::vector<uint8_t> &quantizationTable(ColorDepth depth) {
+    if (depth == ColorDepth::Palette256) {
+        static const auto table = buildQuantizationTable(depth);
+        return table;
+    }
+    static const auto table = buildQuantizationTable(depth);
+    return table;
+}
+
+ConvertRow rowConverter(Kernel kernel) {
+    switch (kernel) {
+#ifdef CAMERACLI_X86_64
+    case Kernel::Avx2:
+        return convertRowAvx2;
+    case Kernel::Sse2:
+        return convertRowSse2;
+#endif
+    default:
+        return convertRowScalar;
+    }
+}
+} // namespace
+
+Kernel bestKernel() {
+#ifdef CAMERACLI_X86_64
+    static const Kernel kernel = cpuHasAvx2() ? Kernel::Avx2 : Kernel::Sse2;
+    return kernel;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+std::string_view kernelName(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Avx2:
+        return "avx2";
+    case Kernel::Sse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+void convertToCells(const uint8_t *pixels, int width, int height, FrameOptions frameOptions,
+                    CellGrid &grid, Kernel kernel) {
+    ConvertRow convertRow = rowConverter(kernel);
+    size_t stride = (size_t)width * 3;
+    auto sourceRow = [&](int y) {
+        return pixels + (frameOptions.flipY ? height - 1 - y : y) * stride;
+    };
+
+    if (frameOptions.ascii) {
+        grid.resize(frameOptions.grayscale ? CellMode::Glyph : CellMode::ColoredGlyph, width,
+                    height);
+        auto &glyphs = glyphTable();
+        for (int y = 0; y < grid.height; y++) {
+            uint8_t *row = grid.glyphs.data() + grid.index(0, y);
+            convertRow(sourceRow(y), width, frameOptions.flipX, false,
+                       grid.foreground.data() + grid.index(0, y),
+                       frameOptions.grayscale ? row : nullptr);
+            if (frameOptions.grayscale) {
+                for (int x = 0; x < width; x++)
+                    row[x] = glyphs[row[x]];
+            } else
+                memset(row, '$', width);
+        }
+    } else {
+        grid.resize(CellMode::HalfBlock, width, height / 2);
+        for (int y = 0; y < grid.height; y++) {
+            convertRow(sourceRow(y * 2), width, frameOptions.flipX, frameOptions.grayscale,
+                       grid.foreground.data() + grid.index(0, y), nullptr);
+            convertRow(sourceRow(y * 2 + 1), width, frameOptions.flipX, frameOptions.grayscale,
+                       grid.background.data() + grid.index(0, y), nullptr);
+        }
+    }
+}
+
+void convertLumaToCells(const uint8_t *lumas, int width, int height, FrameOptions frameOptions,
+                        bool fullRange, CellGrid &grid) {
+    auto &levels = lumaTable(fullRange);
+    auto sourceRow = [&](int y) {
+        return lumas + (size_t)(frameOptions.flipY ? height - 1 - y : y) * width;
+    };
+    auto convertRow = [&](const uint8_t *source, uint32_t *colors) {
+        for (int x = 0; x < width; x++)
+            colors[x] = levels[source[frameOptions.flipX ? width - 1 - x : x]] * 0x010101;
+    };
+
+    if (frameOptions.ascii) {
+        // Glyph cells use the terminal's colours, so only the glyph is needed.
+        grid.resize(CellMode::Glyph, width, height);
+        auto &glyphs = glyphTable();
+        for (int y = 0; y < grid.height; y++) {
+            const uint8_t *source = sourceRow(y);
+            uint8_t *row = grid.glyphs.data() + grid.index(0, y);
+            for (int x = 0; x < width; x++)
+                row[x] = glyphs[levels[source[frameOptions.flipX ? width - 1 - x : x]]];
+        }
+    } else {
+        grid.resize(CellMode::HalfBlock, width, height / 2);
+        for (int y = 0; y < grid.height; y++) {
+            convertRow(sourceRow(y * 2), grid.foreground.data() + grid.index(0, y));
+            convertRow(sourceRow(y * 2 + 1), grid.background.data() + grid.index(0, y));
+        }
+    }
+}
+
+void quantizeCells(CellGrid &grid, ColorDepth depth, bool dither) {
+    if (depth == ColorDepth::TrueColor || grid.colors != ColorDepth::TrueColor)
+        return;
+    grid.colors = depth;
+    if (grid.mode == CellMode::Glyph)
+        return;
+
+    static const int bayer[16] = {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+    int spread = depth == ColorDepth::Palette256 ? DITHER_SPREAD_256 : DITHER_SPREAD_16;
+    std::array<int, 16> offsets = {};
+    if (dither) {
+        for (int i = 0; i < 16; i++)
+            offsets[i] = (bayer[i] * 2 - 15) * spread / 32;
+    }
+
+    auto &table = quantizationTable(depth);
+    // x and y are in pixels, so both halves of a half block get their own threshold.
+    auto quantize = [&](uint32_t &color, int x, int y) {
+        int offset = offsets[(y & 3) * 4 + (x & 3)];
+        auto channel = [&](int shift) {
+            int value = (int)(color >> shift & 0xFF) + offset;
+            return (value < 0 ? 0 : value > 255 ? 255 : value) >> 3;
+        };
+        color = table[channel(0) | channel(8) << 5 | channel(16) << 10];
+    };
+    bool halfBlocks = grid.mode == CellMode::HalfBlock;
+    for (int y = 0; y < grid.height; y++) {
+        for (int x = 0; x < grid.width; x++) {
+            size_t i = grid.index(x, y);
+            quantize(grid.foreground[i], x, halfBlocks ? y * 2 : y);
+            if (halfBlocks)
+                quantize(grid.background[i], x, y * 2 + 1);
+        }
+    }
+}
+} // namespace cameracli
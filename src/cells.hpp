@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "ansi.hpp"
+
+namespace cameracli {
+struct FrameOptions {
+    bool ascii, flipX, flipY, grayscale;
+    ColorDepth colors = ColorDepth::TrueColor;
+    bool dither = false;
+};
+
+enum class Kernel { Scalar, Sse2, Avx2 };
+
+// The fastest kernel the running CPU supports.
+Kernel bestKernel();
+std::string_view kernelName(Kernel kernel);
+
+// Converts a packed RGB24 image into cells in a single pass. ASCII modes map one pixel to one
+// cell, half blocks stack two rows per cell, so height has to be even for those. Flipping is
+// done by remapping rows and columns while reading rather than by moving pixels around.
+void convertToCells(const uint8_t *pixels, int width, int height, FrameOptions frameOptions,
+                    CellGrid &grid, Kernel kernel = bestKernel());
+
+// Grayscale counterpart of convertToCells that reads a plane of BT.601 luma, so YUV frames never
+// need their chroma in grayscale modes.
+void convertLumaToCells(const uint8_t *lumas, int width, int height, FrameOptions frameOptions,
+                        bool fullRange, CellGrid &grid);
+
+// Maps the colours of a true colour grid to the nearest entries of a smaller palette through a
+// precomputed table, optionally with 4x4 ordered dithering so gradients don't band.
+void quantizeCells(CellGrid &grid, ColorDepth depth, bool dither);
+} // namespace cameracli
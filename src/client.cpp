@@ -0,0 +1,142 @@
+#include "client.hpp"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "stream.hpp"
+#endif
+
+#define CLIENT_READ_SIZE 65536
+
+namespace cameracli {
+#ifdef _WIN32
+void runClient(const Options &) {
+    throw std::runtime_error("--connect needs Unix domain sockets, which aren't supported here");
+}
+#else
+namespace {
+// Switches to the alternate screen with the cursor hidden and keys delivered unechoed one at a
+// time, and puts everything back on destruction.
+class TerminalGuard {
+public:
+    TerminalGuard() {
+        interactive_ = tcgetattr(STDIN_FILENO, &saved_) == 0;
+        if (interactive_) {
+            termios raw = saved_;
+            raw.c_lflag &= ~(ICANON | ECHO);
+            tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        }
+        writeAll(STDOUT_FILENO, "\x1b[?1049h\x1b[?25l\x1b[2J");
+    }
+
+    ~TerminalGuard() {
+        try {
+            writeAll(STDOUT_FILENO, "\x1b[m\x1b[?25h\x1b[?1049l");
+        } catch (const std::exception &) {
+        }
+        if (interactive_)
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved_);
+    }
+
+private:
+    termios saved_;
+    bool interactive_;
+};
+
+void measureTerminal(StreamHello &hello) {
+    winsize size = {};
+    bool measured = ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col && size.ws_row;
+    hello.columns = measured ? size.ws_col : 80;
+    hello.rows = measured ? size.ws_row : 24;
+}
+} // namespace
+
+void runClient(const Options &options) {
+    auto connection = connectTo(options.connect);
+    if (connection.get() < 0)
+        throw std::runtime_error("couldn't connect to " + options.connect);
+
+    SignalPipe signals({SIGINT, SIGTERM, SIGWINCH});
+    TerminalGuard terminal;
+    StreamHello hello;
+    hello.frameOptions = options.frameOptions;
+    measureTerminal(hello);
+    writeAll(connection.get(), encodeHello(hello));
+
+    MessageReader reader;
+    std::string data(CLIENT_READ_SIZE, '\0');
+    // Negative once stdin has run out, which poll() then ignores.
+    int input = STDIN_FILENO;
+    while (true) {
+        pollfd descriptors[] = {{signals.fd(), POLLIN, 0},
+                                {input, POLLIN, 0},
+                                {connection.get(), POLLIN, 0}};
+        if (poll(descriptors, 3, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("couldn't wait for the server");
+        }
+
+        // Frames of the old size or options may still arrive after a change; the next full
+        // redraw replaces them.
+        bool changed = false;
+        if (descriptors[0].revents) {
+            while (int signal = signals.next()) {
+                if (signal != SIGWINCH)
+                    return;
+                measureTerminal(hello);
+                changed = true;
+            }
+        }
+        if (descriptors[1].revents) {
+            char key;
+            ssize_t received = read(input, &key, 1);
+            if (received == 0 || (received < 0 && errno != EINTR))
+                input = -1;
+            else if (received == 1) {
+                auto &frameOptions = hello.frameOptions;
+                bool *option = key == 'a'   ? &frameOptions.ascii
+                               : key == 'g' ? &frameOptions.grayscale
+                               : key == 'x' ? &frameOptions.flipX
+                               : key == 'y' ? &frameOptions.flipY
+                               : key == 'd' ? &frameOptions.dither
+                                            : nullptr;
+                if (key == 'q')
+                    return;
+                if (option) {
+                    *option = !*option;
+                    changed = true;
+                }
+            }
+        }
+        if (changed) {
+            writeAll(STDOUT_FILENO, "\x1b[m\x1b[2J");
+            writeAll(connection.get(), encodeHello(hello));
+        }
+
+        if (descriptors[2].revents) {
+            ssize_t received = read(connection.get(), data.data(), data.size());
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received <= 0)
+                throw std::runtime_error("the server closed the connection");
+            reader.append(data.data(), received);
+            // Only the newest of the frames that came in together is worth drawing.
+            std::string_view frame, newest;
+            while (reader.next(frame))
+                newest = frame;
+            if (!newest.empty())
+                writeAll(STDOUT_FILENO, newest);
+        }
+    }
+}
+#endif
+} // namespace cameracli
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "options.hpp"
+
+namespace cameracli {
+// Connects to the server at options.connect and shows its frames in this terminal.
+void runClient(const Options &options);
+} // namespace cameracli
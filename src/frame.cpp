@@ -0,0 +1,217 @@
+#include <new>
+
+// stb_image_resize2 allocates its samplers through the C++ allocator like everything else, so
+// that replacing operator new, as the allocation test does, sees them too.
+#define STBIR_MALLOC(size, context) ((void)(context), ::operator new(size, std::nothrow))
+#define STBIR_FREE(memory, context) ((void)(context), ::operator delete(memory))
+#define STB_IMAGE_RESIZE2_IMPLEMENTATION
+#include "frame.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// Enough for one plane in both cell modes at every pacing reduction level.
+#define FRAME_POOL_MAXIMUM_RESOLUTIONS 6
+// The same sizes, for the resize samplers of one plane.
+#define FRAME_RESIZER_MAXIMUM_SAMPLERS 6
+
+namespace cameracli {
+namespace {
+// Byte offsets of Y, U and V within a two-pixel group of packed 4:2:2.
+struct PackedLayout {
+    int luma, blue, red;
+};
+
+PackedLayout packedLayout(FrameFormat format) {
+    return format == FrameFormat::YUYV ? PackedLayout{0, 1, 3} : PackedLayout{1, 0, 2};
+}
+
+const void *readPackedLuma(void *output, const void *, int pixels, int x, int y, void *context) {
+    auto &frame = *(const FrameView *)context;
+    const uint8_t *row = frame.data[0] + y * frame.stride[0] + packedLayout(frame.format).luma;
+    auto *luma = (uint8_t *)output;
+    for (int i = 0; i < pixels; i++)
+        luma[i] = row[(x + i) * 2];
+    return output;
+}
+
+const void *readPackedChroma(void *output, const void *, int pixels, int x, int y, void *context) {
+    auto &frame = *(const FrameView *)context;
+    auto layout = packedLayout(frame.format);
+    const uint8_t *row = frame.data[0] + y * frame.stride[0];
+    auto *chroma = (uint8_t *)output;
+    for (int i = 0; i < pixels; i++) {
+        chroma[i * 2] = row[(x + i) * 4 + layout.blue];
+        chroma[i * 2 + 1] = row[(x + i) * 4 + layout.red];
+    }
+    return output;
+}
+
+const void *readPlanarChroma(void *output, const void *, int pixels, int x, int y, void *context) {
+    auto &frame = *(const FrameView *)context;
+    const uint8_t *blue = frame.data[1] + y * frame.stride[1] + x;
+    const uint8_t *red = frame.data[2] + y * frame.stride[2] + x;
+    auto *chroma = (uint8_t *)output;
+    for (int i = 0; i < pixels; i++) {
+        chroma[i * 2] = blue[i];
+        chroma[i * 2 + 1] = red[i];
+    }
+    return output;
+}
+} // namespace
+
+std::string_view frameFormatName(FrameFormat format) {
+    switch (format) {
+    case FrameFormat::NV12:
+        return "nv12";
+    case FrameFormat::I420:
+        return "i420";
+    case FrameFormat::YUYV:
+        return "yuyv";
+    case FrameFormat::UYVY:
+        return "uyvy";
+    default:
+        return "rgb24";
+    }
+}
+
+void yuvToRgb(const uint8_t *luma, const uint8_t *chroma, int width, int height, bool fullRange,
+              uint8_t *rgb) {
+    for (size_t i = 0, pixels = (size_t)width * height; i < pixels; i++)
+        yuvToRgb(luma[i], chroma[i * 2], chroma[i * 2 + 1], fullRange, rgb + i * 3);
+}
+
+PlaneView rgbPlane(const FrameView &frame) {
+    return {frame.data[0], frame.width, frame.height, frame.stride[0], STBIR_RGB,
+            STBIR_TYPE_UINT8_SRGB};
+}
+
+PlaneView lumaPlane(const FrameView &frame) {
+    PlaneView plane = {frame.data[0], frame.width, frame.height, frame.stride[0], STBIR_1CHANNEL,
+                       STBIR_TYPE_UINT8};
+    if (frame.format == FrameFormat::YUYV || frame.format == FrameFormat::UYVY) {
+        plane.callback = readPackedLuma;
+        plane.context = (void *)&frame;
+    }
+    return plane;
+}
+
+PlaneView chromaPlane(const FrameView &frame) {
+    int width = (frame.width + 1) / 2, height = (frame.height + 1) / 2;
+    switch (frame.format) {
+    case FrameFormat::NV12:
+        return {frame.data[1], width, height, frame.stride[1], STBIR_2CHANNEL, STBIR_TYPE_UINT8};
+    case FrameFormat::I420:
+        return {frame.data[1], width, height, frame.stride[1], STBIR_2CHANNEL,
+                STBIR_TYPE_UINT8, readPlanarChroma, (void *)&frame};
+    default:
+        // 4:2:2 only halves the horizontal chroma resolution.
+        return {frame.data[0], width, frame.height, frame.stride[0], STBIR_2CHANNEL,
+                STBIR_TYPE_UINT8, readPackedChroma, (void *)&frame};
+    }
+}
+
+PooledFrame::PooledFrame(PooledFrame &&other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr))
+    , buffer_(std::move(other.buffer_))
+    , width_(std::exchange(other.width_, 0))
+    , height_(std::exchange(other.height_, 0))
+    , channels_(std::exchange(other.channels_, 0)) {}
+
+PooledFrame &PooledFrame::operator=(PooledFrame &&other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = std::exchange(other.pool_, nullptr);
+        buffer_ = std::move(other.buffer_);
+        width_ = std::exchange(other.width_, 0);
+        height_ = std::exchange(other.height_, 0);
+        channels_ = std::exchange(other.channels_, 0);
+    }
+    return *this;
+}
+
+PooledFrame::~PooledFrame() { release(); }
+
+void PooledFrame::release() {
+    if (pool_)
+        pool_->release(std::move(buffer_), width_, height_, channels_);
+    pool_ = nullptr;
+}
+
+PooledFrame FramePool::acquire(int width, int height, int channels) {
+    PooledFrame frame;
+    frame.pool_ = this;
+    frame.width_ = width;
+    frame.height_ = height;
+    frame.channels_ = channels;
+    for (auto &bucket : buckets_) {
+        if (bucket.width == width && bucket.height == height && bucket.channels == channels &&
+            !bucket.buffers.empty()) {
+            frame.buffer_ = std::move(bucket.buffers.back());
+            bucket.buffers.pop_back();
+            return frame;
+        }
+    }
+    frame.buffer_.resize((size_t)width * height * channels);
+    return frame;
+}
+
+void FramePool::release(std::vector<uint8_t> buffer, int width, int height, int channels) {
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        auto &bucket = buckets_[i];
+        if (bucket.width == width && bucket.height == height && bucket.channels == channels) {
+            bucket.buffers.push_back(std::move(buffer));
+            // Keep the most recently used resolution at the front.
+            std::rotate(buckets_.begin(), buckets_.begin() + i, buckets_.begin() + i + 1);
+            return;
+        }
+    }
+    if (buckets_.size() == FRAME_POOL_MAXIMUM_RESOLUTIONS)
+        buckets_.pop_back();
+    buckets_.insert(buckets_.begin(), Bucket{width, height, channels, {}});
+    buckets_.front().buffers.push_back(std::move(buffer));
+}
+
+FrameResizer::~FrameResizer() {
+    for (auto &samplers : samplers_)
+        stbir_free_samplers(&samplers.resize);
+}
+
+void FrameResizer::resize(const PlaneView &source, uint8_t *output, int width, int height) {
+    auto &resize = samplers(source, output, width, height);
+    stbir_set_buffer_ptrs(&resize, source.data, (int)source.stride, output, 0);
+    stbir_set_pixel_callbacks(&resize, source.callback, nullptr);
+    stbir_set_user_data(&resize, source.context);
+    if (!stbir_resize_extended(&resize))
+        throw std::runtime_error("couldn't resize frame");
+}
+
+STBIR_RESIZE &FrameResizer::samplers(const PlaneView &source, uint8_t *output, int width,
+                                     int height) {
+    for (size_t i = 0; i < samplers_.size(); i++) {
+        auto &samplers = samplers_[i];
+        if (samplers.sourceWidth == source.width && samplers.sourceHeight == source.height &&
+            samplers.width == width && samplers.height == height &&
+            samplers.layout == source.layout && samplers.type == source.type) {
+            std::rotate(samplers_.begin(), samplers_.begin() + i, samplers_.begin() + i + 1);
+            return samplers_.front().resize;
+        }
+    }
+
+    // Reserved up front, so that inserting can't throw once the samplers are built.
+    samplers_.reserve(FRAME_RESIZER_MAXIMUM_SAMPLERS);
+    if (samplers_.size() == FRAME_RESIZER_MAXIMUM_SAMPLERS) {
+        stbir_free_samplers(&samplers_.back().resize);
+        samplers_.pop_back();
+    }
+    Samplers samplers = {{}, source.width, source.height, width, height, source.layout,
+                         source.type};
+    stbir_resize_init(&samplers.resize, source.data, source.width, source.height,
+                      (int)source.stride, output, width, height, 0, source.layout, source.type);
+    if (!stbir_build_samplers(&samplers.resize))
+        throw std::runtime_error("couldn't build resize samplers");
+    samplers_.insert(samplers_.begin(), samplers);
+    return samplers_.front().resize;
+}
+} // namespace cameracli
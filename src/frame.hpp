@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <stb/stb_image_resize2.h>
+
+namespace cameracli {
+enum class FrameFormat {
+    RGB24,
+    NV12, // Y plane, then a half-resolution plane of interleaved U and V
+    I420, // Y plane, then half-resolution U and V planes
+    YUYV, // packed 4:2:2, Y0 U Y1 V
+    UYVY, // packed 4:2:2, U Y0 V Y1
+};
+
+std::string_view frameFormatName(FrameFormat format);
+
+// BT.601 YCbCr to RGB24 in 8.8 fixed point.
+inline void yuvToRgb(int y, int u, int v, bool fullRange, uint8_t *rgb) {
+    auto clamp = [](int value) { return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value); };
+    int d = u - 128, e = v - 128;
+    if (fullRange) {
+        int c = y * 256 + 128;
+        rgb[0] = clamp((c + 359 * e) >> 8);
+        rgb[1] = clamp((c - 88 * d - 183 * e) >> 8);
+        rgb[2] = clamp((c + 454 * d) >> 8);
+    } else {
+        int c = (y - 16) * 298 + 128;
+        rgb[0] = clamp((c + 409 * e) >> 8);
+        rgb[1] = clamp((c - 100 * d - 208 * e) >> 8);
+        rgb[2] = clamp((c + 516 * d) >> 8);
+    }
+}
+
+// Converts width x height pixels of Y and interleaved UV, both at full resolution, to RGB24.
+void yuvToRgb(const uint8_t *luma, const uint8_t *chroma, int width, int height, bool fullRange,
+              uint8_t *rgb);
+
+// Non-owning view of an image. Packed formats only use the first plane.
+struct FrameView {
+    FrameFormat format = FrameFormat::RGB24;
+    int width = 0, height = 0;
+    const uint8_t *data[3] = {};
+    size_t stride[3] = {};
+    bool fullRange = false; // YUV formats only
+
+    static FrameView rgb(const uint8_t *data, int width, int height, size_t stride) {
+        return {FrameFormat::RGB24, width, height, {data}, {stride}};
+    }
+};
+
+// One plane of a frame as stb_image_resize2 reads it. Planes that aren't stored as plain rows,
+// like the luma of packed YUV or the chroma of I420, are assembled by callback a scanline at a
+// time, with context pointing at the FrameView.
+struct PlaneView {
+    const uint8_t *data;
+    int width, height;
+    size_t stride;
+    stbir_pixel_layout layout;
+    stbir_datatype type;
+    stbir_input_callback *callback = nullptr;
+    void *context = nullptr;
+};
+
+PlaneView rgbPlane(const FrameView &frame);
+PlaneView lumaPlane(const FrameView &frame);
+// Interleaved U and V at chroma resolution.
+PlaneView chromaPlane(const FrameView &frame);
+
+class FramePool;
+
+// Storage for an image with 1 to 3 bytes per pixel, borrowed from a FramePool and handed back
+// to it on destruction.
+class PooledFrame {
+public:
+    PooledFrame() = default;
+    PooledFrame(PooledFrame &&other) noexcept;
+    PooledFrame &operator=(PooledFrame &&other) noexcept;
+    ~PooledFrame();
+
+    uint8_t *data() { return buffer_.data(); }
+    const uint8_t *data() const { return buffer_.data(); }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    bool matches(int width, int height, int channels) const {
+        return width_ == width && height_ == height && channels_ == channels;
+    }
+
+private:
+    friend class FramePool;
+    void release();
+
+    FramePool *pool_ = nullptr;
+    std::vector<uint8_t> buffer_;
+    int width_ = 0, height_ = 0, channels_ = 0;
+};
+
+// Recycles frame buffers by resolution so that switching between a few sizes doesn't reallocate.
+// Only the most recently used resolutions are kept. Not thread-safe; the pool has to outlive
+// every frame acquired from it.
+class FramePool {
+public:
+    PooledFrame acquire(int width, int height, int channels = 3);
+
+private:
+    friend class PooledFrame;
+    void release(std::vector<uint8_t> buffer, int width, int height, int channels);
+
+    struct Bucket {
+        int width, height, channels;
+        std::vector<std::vector<uint8_t>> buffers;
+    };
+    std::vector<Bucket> buckets_;
+};
+
+// Resizes one plane. Samplers are built once for each source size, target size and pixel layout,
+// and those of the most recently used few are kept, so neither resizing a video stream nor
+// switching back and forth between modes or reduction levels allocates.
+class FrameResizer {
+public:
+    FrameResizer() = default;
+    FrameResizer(const FrameResizer &) = delete;
+    FrameResizer &operator=(const FrameResizer &) = delete;
+    ~FrameResizer();
+
+    void resize(const PlaneView &source, uint8_t *output, int width, int height);
+
+private:
+    struct Samplers {
+        STBIR_RESIZE resize;
+        int sourceWidth, sourceHeight, width, height;
+        stbir_pixel_layout layout;
+        stbir_datatype type;
+    };
+    STBIR_RESIZE &samplers(const PlaneView &source, uint8_t *output, int width, int height);
+
+    // Most recently used first.
+    std::vector<Samplers> samplers_;
+};
+} // namespace cameracli
@@ -0,0 +1,139 @@
+#include "options.hpp"
+
+#include <stdexcept>
+#include <string_view>
+
+#include <spdlog/fmt/fmt.h>
+
+namespace cameracli {
+namespace {
+void parseSize(std::string_view option, std::string_view value, int &width, int &height) {
+    auto separator = value.find('x');
+    try {
+        if (separator == std::string_view::npos)
+            throw std::invalid_argument("missing 'x'");
+        width = std::stoi(std::string(value.substr(0, separator)));
+        height = std::stoi(std::string(value.substr(separator + 1)));
+    } catch (const std::exception &) {
+        throw std::runtime_error(fmt::format("{} expects WIDTHxHEIGHT, got '{}'", option, value));
+    }
+    if (width <= 0 || height <= 0)
+        throw std::runtime_error(fmt::format("{} must be positive, got '{}'", option, value));
+}
+
+int parseCount(std::string_view option, std::string_view value) {
+    try {
+        int count = std::stoi(std::string(value));
+        if (count > 0)
+            return count;
+    } catch (const std::exception &) {
+    }
+    throw std::runtime_error(fmt::format("{} expects a positive number, got '{}'", option, value));
+}
+
+FrameFormat parsePixelFormat(std::string_view option, std::string_view value) {
+    for (auto format : {FrameFormat::RGB24, FrameFormat::NV12, FrameFormat::I420,
+                        FrameFormat::YUYV, FrameFormat::UYVY}) {
+        if (value == frameFormatName(format))
+            return format;
+    }
+    throw std::runtime_error(
+        fmt::format("{} expects rgb24, nv12, i420, yuyv or uyvy, got '{}'", option, value));
+}
+
+ColorDepth parseColorDepth(std::string_view option, std::string_view value) {
+    if (value == "auto")
+        return detectColorDepth();
+    for (auto depth : {ColorDepth::TrueColor, ColorDepth::Palette256, ColorDepth::Palette16}) {
+        if (value == colorDepthName(depth))
+            return depth;
+    }
+    throw std::runtime_error(
+        fmt::format("{} expects auto, truecolor, 256 or 16, got '{}'", option, value));
+}
+} // namespace
+
+Options parseOptions(int argc, char const *argv[]) {
+    Options options;
+    options.frameOptions.colors = detectColorDepth();
+    for (int i = 1; i < argc; i++) {
+        std::string_view option = argv[i];
+        auto value = [&] {
+            if (i + 1 >= argc)
+                throw std::runtime_error(fmt::format("{} expects a value", option));
+            return std::string_view(argv[++i]);
+        };
+
+        if (option == "--source")
+            options.source = value();
+        else if (option == "--pixel-format")
+            options.pixelFormat = parsePixelFormat(option, value());
+        else if (option == "--size")
+            parseSize(option, value(), options.sourceWidth, options.sourceHeight);
+        else if (option == "--ascii")
+            options.frameOptions.ascii = true;
+        else if (option == "--grayscale")
+            options.frameOptions.grayscale = true;
+        else if (option == "--flip-x")
+            options.frameOptions.flipX = true;
+        else if (option == "--flip-y")
+            options.frameOptions.flipY = true;
+        else if (option == "--colors")
+            options.frameOptions.colors = parseColorDepth(option, value());
+        else if (option == "--dither")
+            options.frameOptions.dither = true;
+        else if (option == "--fps")
+            options.maximumFrameRate = parseCount(option, value());
+        else if (option == "--bench")
+            options.bench = true;
+        else if (option == "--frames")
+            options.benchFrames = parseCount(option, value());
+        else if (option == "--terminal")
+            parseSize(option, value(), options.columns, options.rows);
+        else if (option == "--json")
+            options.json = value();
+        else if (option == "--trace")
+            options.trace = value();
+        else if (option == "--serve")
+            options.serve = value();
+        else if (option == "--connect")
+            options.connect = value();
+        else if (option == "-h" || option == "--help")
+            options.help = true;
+        else
+            throw std::runtime_error(fmt::format("unknown option '{}', see --help", option));
+    }
+    return options;
+}
+
+void printUsage() {
+    fmt::print(R"(Usage: cameracli [options]
+
+Options:
+  --source SOURCE       camera (default), synthetic, or a raw RGB24 or .y4m file
+  --pixel-format FMT    format to capture or generate: nv12 (default), i420, yuyv, uyvy or
+                        rgb24
+  --size WxH            size of synthetic and raw RGB24 frames (default 1280x720)
+  --ascii               start in ASCII mode
+  --grayscale           start in grayscale mode
+  --flip-x              start with horizontal flipping
+  --flip-y              start with vertical flipping
+  --colors DEPTH        auto (default, from COLORTERM and TERM), truecolor, 256 or 16
+  --dither              dither colours with a 4x4 ordered pattern when they are limited
+  --fps N               redraw at most N times a second (default 30)
+  --trace FILE          record a timeline of every stage to FILE, in Chrome trace event JSON
+  -h, --help            show this help
+
+Benchmark:
+  --bench               run frames through the pipeline without a terminal and report timings
+  --frames N            number of frames to measure (default 300)
+  --terminal COLSxROWS  terminal area to render into (default 200x50)
+  --json FILE           also write the report to FILE as JSON
+
+Sharing:
+  --serve SOCKET        capture from --source and stream it to clients on a Unix socket
+  --connect SOCKET      show the stream of a server in this terminal, with the frame options
+                        given; a, g, x, y and d toggle them and q quits
+)");
+}
+} // namespace cameracli
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "cells.hpp"
+#include "frame.hpp"
+
+namespace cameracli {
+struct Options {
+    std::string source = "camera";
+    FrameFormat pixelFormat = FrameFormat::NV12;
+    int sourceWidth = 1280, sourceHeight = 720;
+    FrameOptions frameOptions{};
+    int maximumFrameRate = 30;
+
+    bool bench = false;
+    int benchFrames = 300;
+    int columns = 200, rows = 50;
+    std::string json;
+
+    std::string serve, connect;
+
+    std::string trace;
+
+    bool help = false;
+};
+
+Options parseOptions(int argc, char const *argv[]);
+void printUsage();
+} // namespace cameracli
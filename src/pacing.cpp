@@ -0,0 +1,89 @@
+#include "pacing.hpp"
+
+#include "profile.hpp"
+
+#define PACING_MAXIMUM_REDUCTION 2
+// Consecutive frames over the interval before reducing detail.
+#define PACING_OVERRUN_FRAMES 3
+// Consecutive frames drawn in under PACING_HEADROOM of the interval before restoring detail.
+// Restoring roughly doubles the cost, so the headroom has to cover that.
+#define PACING_HEADROOM_FRAMES 30
+#define PACING_HEADROOM 0.4
+
+namespace cameracli {
+FrameScheduler::FrameScheduler(double maximumFrameRate, std::function<void()> redraw)
+    : interval_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1 / maximumFrameRate)))
+    , redraw_(std::move(redraw))
+    , thread_([this] { schedule(); }) {}
+
+FrameScheduler::~FrameScheduler() {
+    {
+        std::lock_guard lock(mutex_);
+        running_ = false;
+    }
+    changed_.notify_one();
+    thread_.join();
+}
+
+void FrameScheduler::frameArrived() {
+    {
+        std::lock_guard lock(mutex_);
+        arrived_ = true;
+    }
+    changed_.notify_one();
+}
+
+void FrameScheduler::frameStarted() { started_ = Clock::now(); }
+
+void FrameScheduler::frameFinished() {
+    auto finished = Clock::now();
+    PROFILE_SPAN(Draw, started_, finished);
+    PROFILE_COUNT(DrawnFrames);
+    adapt(finished - started_);
+    {
+        std::lock_guard lock(mutex_);
+        drawing_ = false;
+    }
+    changed_.notify_one();
+}
+
+void FrameScheduler::schedule() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        changed_.wait(lock, [&] { return !running_ || (arrived_ && !drawing_); });
+        if (!running_)
+            return;
+        if (Clock::now() < next_) {
+            changed_.wait_until(lock, next_, [&] { return !running_; });
+            continue;
+        }
+        arrived_ = false;
+        drawing_ = true;
+        next_ = Clock::now() + interval_;
+        lock.unlock();
+        redraw_();
+        lock.lock();
+    }
+}
+
+void FrameScheduler::adapt(Clock::duration cost) {
+    if (cost > interval_) {
+        fastFrames_ = 0;
+        if (++overruns_ >= PACING_OVERRUN_FRAMES && reduction_ < PACING_MAXIMUM_REDUCTION) {
+            reduction_++;
+            overruns_ = 0;
+        }
+        return;
+    }
+    overruns_ = 0;
+    if (cost > interval_ * PACING_HEADROOM) {
+        fastFrames_ = 0;
+        return;
+    }
+    if (++fastFrames_ >= PACING_HEADROOM_FRAMES && reduction_ > 0) {
+        reduction_--;
+        fastFrames_ = 0;
+    }
+}
+} // namespace cameracli
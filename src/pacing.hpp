@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace cameracli {
+// Decides when the screen is redrawn. A redraw is requested once per new frame, at most
+// maximumFrameRate times a second and never while the previous one is still being drawn, so
+// frames that arrive in the meantime collapse into a single redraw of the newest one.
+//
+// The renderer brackets every draw with frameStarted() and frameFinished(), the latter called
+// once the output has been written. When that repeatedly takes longer than the frame interval
+// the reduction level goes up, and it comes back down once drawing is comfortably fast again.
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameScheduler(double maximumFrameRate, std::function<void()> redraw);
+    ~FrameScheduler();
+
+    // Safe to call from any thread.
+    void frameArrived();
+
+    // Called from the UI thread only.
+    void frameStarted();
+    void frameFinished();
+    // 0 renders at full detail; each step above it trades detail for speed.
+    int reduction() const { return reduction_; }
+
+private:
+    void schedule();
+    void adapt(Clock::duration cost);
+
+    Clock::duration interval_;
+    std::function<void()> redraw_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool running_ = true, arrived_ = false, drawing_ = false;
+    Clock::time_point next_;
+
+    Clock::time_point started_;
+    int reduction_ = 0, overruns_ = 0, fastFrames_ = 0;
+
+    std::thread thread_;
+};
+} // namespace cameracli
@@ -0,0 +1,93 @@
+#include "pipeline.hpp"
+
+#include "profile.hpp"
+
+namespace cameracli {
+namespace {
+// Scales a grid sampled at reduced detail up to width x height cells by repeating columns and
+// rows. With splitRows every half-block row becomes two rows of single-colour cells, one per
+// half.
+void expandCells(const CellGrid &sampled, bool splitRows, int width, int height,
+                 CellGrid &grid) {
+    grid.resize(sampled.mode, width, height);
+    for (int y = 0; y < height; y++) {
+        size_t row = sampled.index(0, splitRows ? y / 2 : y * sampled.height / height);
+        auto &colors = splitRows && y % 2 ? sampled.background : sampled.foreground;
+        auto &backgrounds = splitRows ? colors : sampled.background;
+        for (int x = 0; x < width; x++) {
+            size_t source = row + x * sampled.width / width, target = grid.index(x, y);
+            grid.glyphs[target] = sampled.glyphs[source];
+            grid.foreground[target] = colors[source];
+            grid.background[target] = backgrounds[source];
+        }
+    }
+}
+} // namespace
+
+const CellGrid &FramePipeline::process(const FrameView &source, int width, int height,
+                                       FrameOptions frameOptions, int reduction) {
+    resize(source, width, height, frameOptions, reduction);
+    return convert(frameOptions);
+}
+
+void FramePipeline::resize(const FrameView &source, int width, int height,
+                           FrameOptions frameOptions, int reduction) {
+    PROFILE_SCOPE(Resize);
+    width_ = width;
+    height_ = height;
+    reduced_ = reduction > 0;
+    splitRows_ = reduced_ && !frameOptions.ascii;
+    bool halveColumns = frameOptions.ascii ? reduction >= 1 : reduction >= 2;
+    if (halveColumns)
+        width = (width + 1) / 2;
+    int rows = height * 2;
+    if (frameOptions.ascii)
+        rows = reduction >= 2 ? (height + 1) / 2 : height;
+    else if (splitRows_)
+        // Half blocks need an even number of rows, so a split grid may come out one row over.
+        rows = (height + 1) / 2 * 2;
+    source_ = source;
+    if (source_.format == FrameFormat::RGB24) {
+        lumaOnly_ = false;
+        resizer_.resize(rgbPlane(source_), acquire(resizedPool_, resized_, width, rows, 3).data(),
+                        width, rows);
+        return;
+    }
+
+    lumaOnly_ = frameOptions.grayscale;
+    resizer_.resize(lumaPlane(source_), acquire(lumaPool_, luma_, width, rows, 1).data(), width,
+                    rows);
+    if (lumaOnly_)
+        return;
+    chromaResizer_.resize(chromaPlane(source_),
+                          acquire(chromaPool_, chroma_, width, rows, 2).data(), width, rows);
+    acquire(resizedPool_, resized_, width, rows, 3);
+}
+
+const CellGrid &FramePipeline::convert(FrameOptions frameOptions) {
+    PROFILE_SCOPE(Convert);
+    // The camera image is mirrored unless "Flip X" is ticked.
+    frameOptions.flipX = !frameOptions.flipX;
+    auto &cells = reduced_ ? sampled_ : grid_;
+    if (lumaOnly_) {
+        convertLumaToCells(luma_.data(), luma_.width(), luma_.height(), frameOptions,
+                           source_.fullRange, cells);
+    } else {
+        if (source_.format != FrameFormat::RGB24)
+            yuvToRgb(luma_.data(), chroma_.data(), luma_.width(), luma_.height(),
+                     source_.fullRange, resized_.data());
+        convertToCells(resized_.data(), resized_.width(), resized_.height(), frameOptions, cells);
+    }
+    if (reduced_)
+        expandCells(sampled_, splitRows_, width_, height_, grid_);
+    quantizeCells(grid_, frameOptions.colors, frameOptions.dither);
+    return grid_;
+}
+
+PooledFrame &FramePipeline::acquire(FramePool &pool, PooledFrame &frame, int width, int height,
+                                    int channels) {
+    if (!frame.matches(width, height, channels))
+        frame = pool.acquire(width, height, channels);
+    return frame;
+}
+} // namespace cameracli
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ansi.hpp"
+#include "cells.hpp"
+#include "frame.hpp"
+
+namespace cameracli {
+// Turns captured frames into cells for a terminal area of width x height cells. Buffers,
+// resize samplers and the cell grid are kept between frames, so once the sizes settle a frame
+// goes through without touching the heap.
+//
+// YUV frames are resized plane by plane and only converted to RGB at cell resolution. Grayscale
+// modes don't need chroma at all, so they resize and map just the luma plane. Colours are
+// quantized last, if frameOptions asks for a palette.
+//
+// A non-zero reduction samples the image more coarsely and scales the cells back up: at 1
+// half blocks get a single colour each, which also lets them be written as plain spaces, and
+// ASCII cells are sampled every other column; at 2 half blocks are sampled every other column
+// as well, and ASCII cells every other row.
+class FramePipeline {
+public:
+    const CellGrid &process(const FrameView &source, int width, int height,
+                            FrameOptions frameOptions, int reduction = 0);
+    // The two halves of process(), for callers that time them separately.
+    void resize(const FrameView &source, int width, int height, FrameOptions frameOptions,
+                int reduction = 0);
+    const CellGrid &convert(FrameOptions frameOptions);
+    const CellGrid &grid() const { return grid_; }
+
+private:
+    static PooledFrame &acquire(FramePool &pool, PooledFrame &frame, int width, int height,
+                                int channels);
+
+    // One pool per plane, so switching modes or reduction levels with YUV frames, which use all
+    // three planes, doesn't evict the sizes that are about to be reused.
+    FramePool resizedPool_, lumaPool_, chromaPool_;
+    FrameResizer resizer_, chromaResizer_;
+    // The resize callbacks of packed and planar YUV read the frame through this copy.
+    FrameView source_;
+    PooledFrame resized_, luma_, chroma_;
+    bool lumaOnly_ = false;
+    // Cell area asked for, and whether the sampled grid has to be scaled up to it.
+    int width_ = 0, height_ = 0;
+    bool reduced_ = false, splitRows_ = false;
+    CellGrid sampled_, grid_;
+};
+} // namespace cameracli
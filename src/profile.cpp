@@ -0,0 +1,154 @@
+#include "profile.hpp"
+
+#ifdef CAMERACLI_PROFILING
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+// Trace events are written out in chunks of about this many bytes.
+#define PROFILE_TRACE_CHUNK (64 << 10)
+
+namespace cameracli {
+namespace {
+int threadId() {
+    static std::atomic<int> threads = 0;
+    thread_local int id = ++threads;
+    return id;
+}
+
+std::string_view counterName(ProfileCounter counter) {
+    switch (counter) {
+    case ProfileCounter::CapturedFrames:
+        return "captured";
+    case ProfileCounter::DroppedFrames:
+        return "dropped";
+    default:
+        return "drawn";
+    }
+}
+} // namespace
+
+std::string_view profileStageName(ProfileStage stage) {
+    switch (stage) {
+    case ProfileStage::Capture:
+        return "capture";
+    case ProfileStage::Resize:
+        return "resize";
+    case ProfileStage::Convert:
+        return "convert";
+    case ProfileStage::Encode:
+        return "encode";
+    default:
+        return "draw";
+    }
+}
+
+void SampleRing::record(uint32_t sample) {
+    uint32_t slot = next_.fetch_add(1, std::memory_order_relaxed) % PROFILE_HISTORY;
+    samples_[slot].store(sample, std::memory_order_relaxed);
+}
+
+SampleRing::Summary SampleRing::summarize() const {
+    size_t count = std::min<size_t>(next_.load(std::memory_order_relaxed), PROFILE_HISTORY);
+    if (!count)
+        return {};
+    std::vector<uint32_t> samples(count);
+    for (size_t i = 0; i < count; i++)
+        samples[i] = samples_[i].load(std::memory_order_relaxed);
+    auto percentile = [&](double fraction) {
+        auto nth = samples.begin() + std::min(count - 1, (size_t)(count * fraction));
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth;
+    };
+    return {percentile(0.5), percentile(0.99), count};
+}
+
+void Profiler::record(ProfileStage stage, Clock::time_point start, Clock::time_point end) {
+    auto duration = std::chrono::duration<double, std::micro>(end - start).count();
+    stages_[(size_t)stage].record((uint32_t)duration);
+    if (tracing_.load(std::memory_order_relaxed))
+        trace(R"({{"name":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":1,"tid":{}}})",
+              profileStageName(stage),
+              std::chrono::duration<double, std::micro>(start - epoch_).count(), duration,
+              threadId());
+}
+
+void Profiler::recordBytes(size_t bytes) {
+    bytes_.record((uint32_t)std::min<size_t>(bytes, UINT32_MAX));
+    if (tracing_.load(std::memory_order_relaxed))
+        trace(R"({{"name":"bytes","ph":"C","ts":{:.3f},"pid":1,"args":{{"bytes":{}}}}})",
+              std::chrono::duration<double, std::micro>(Clock::now() - epoch_).count(), bytes);
+}
+
+void Profiler::count(ProfileCounter counter) {
+    counters_[(size_t)counter].fetch_add(1, std::memory_order_relaxed);
+    if (tracing_.load(std::memory_order_relaxed))
+        trace(R"({{"name":"{}","ph":"i","s":"t","ts":{:.3f},"pid":1,"tid":{}}})",
+              counterName(counter),
+              std::chrono::duration<double, std::micro>(Clock::now() - epoch_).count(),
+              threadId());
+}
+
+SampleRing::Summary Profiler::stage(ProfileStage stage) const {
+    return stages_[(size_t)stage].summarize();
+}
+
+uint64_t Profiler::counter(ProfileCounter counter) const {
+    return counters_[(size_t)counter].load(std::memory_order_relaxed);
+}
+
+void Profiler::startTrace(const std::string &path) {
+    std::lock_guard lock(traceMutex_);
+    traceFile_.open(path);
+    if (!traceFile_)
+        throw std::runtime_error("couldn't open " + path);
+    traceBuffer_ = R"({"traceEvents":[)";
+    traceEmpty_ = true;
+    tracing_ = true;
+}
+
+void Profiler::stopTrace() {
+    std::lock_guard lock(traceMutex_);
+    tracing_ = false;
+    traceFile_ << traceBuffer_ << "\n]}\n";
+    traceFile_.close();
+    traceBuffer_.clear();
+}
+
+template <typename... Arguments>
+void Profiler::trace(std::string_view format, Arguments... arguments) {
+    std::lock_guard lock(traceMutex_);
+    // Tracing may have stopped while waiting for the lock.
+    if (!tracing_)
+        return;
+    traceBuffer_ += traceEmpty_ ? "\n" : ",\n";
+    traceEmpty_ = false;
+    fmt::format_to(std::back_inserter(traceBuffer_), fmt::runtime(format), arguments...);
+    if (traceBuffer_.size() >= PROFILE_TRACE_CHUNK) {
+        traceFile_ << traceBuffer_;
+        traceBuffer_.clear();
+    }
+}
+
+CountingOutput::int_type CountingOutput::overflow(int_type character) {
+    if (traits_type::eq_int_type(character, traits_type::eof()))
+        return traits_type::not_eof(character);
+    written_++;
+    return target_->sputc(traits_type::to_char_type(character));
+}
+
+std::streamsize CountingOutput::xsputn(const char *data, std::streamsize size) {
+    auto written = target_->sputn(data, size);
+    written_ += written;
+    return written;
+}
+
+Profiler &profiler() {
+    static Profiler profiler;
+    return profiler;
+}
+} // namespace cameracli
+#endif
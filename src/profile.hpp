@@ -0,0 +1,149 @@
+#pragma once
+
+// Instrumentation for the performance HUD and --trace. Everything here only exists when built
+// with CAMERACLI_PROFILING; otherwise the PROFILE_ macros expand to nothing and their arguments
+// aren't evaluated.
+
+#ifdef CAMERACLI_PROFILING
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Number of recent samples each statistic is computed over.
+#define PROFILE_HISTORY 256
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Times the rest of the enclosing scope as the given ProfileStage.
+#define PROFILE_SCOPE(stage)                                                                      \
+    ::cameracli::ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(                              \
+        ::cameracli::ProfileStage::stage)
+#define PROFILE_SPAN(stage, start, end)                                                           \
+    ::cameracli::profiler().record(::cameracli::ProfileStage::stage, start, end)
+#define PROFILE_COUNT(counter) ::cameracli::profiler().count(::cameracli::ProfileCounter::counter)
+#define PROFILE_BYTES(bytes) ::cameracli::profiler().recordBytes(bytes)
+
+namespace cameracli {
+enum class ProfileStage { Capture, Resize, Convert, Encode, Draw, Count };
+enum class ProfileCounter { CapturedFrames, DroppedFrames, DrawnFrames, Count };
+
+std::string_view profileStageName(ProfileStage stage);
+
+// The most recent PROFILE_HISTORY samples. Any number of threads may record at once without
+// locking; a summary taken meanwhile may include a sample that is half a ring old, which
+// doesn't matter for percentiles.
+class SampleRing {
+public:
+    struct Summary {
+        uint32_t p50 = 0, p99 = 0;
+        size_t count = 0;
+    };
+
+    void record(uint32_t sample);
+    Summary summarize() const;
+
+private:
+    std::array<std::atomic<uint32_t>, PROFILE_HISTORY> samples_{};
+    std::atomic<uint32_t> next_ = 0;
+};
+
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void record(ProfileStage stage, Clock::time_point start, Clock::time_point end);
+    void recordBytes(size_t bytes);
+    void count(ProfileCounter counter);
+
+    // Stage times are in microseconds.
+    SampleRing::Summary stage(ProfileStage stage) const;
+    SampleRing::Summary bytes() const { return bytes_.summarize(); }
+    uint64_t counter(ProfileCounter counter) const;
+
+    // Writes every event from now on to path as Chrome trace event JSON, until stopTrace().
+    void startTrace(const std::string &path);
+    void stopTrace();
+
+private:
+    template <typename... Arguments> void trace(std::string_view format, Arguments... arguments);
+
+    Clock::time_point epoch_ = Clock::now();
+    std::array<SampleRing, (size_t)ProfileStage::Count> stages_;
+    SampleRing bytes_;
+    std::array<std::atomic<uint64_t>, (size_t)ProfileCounter::Count> counters_{};
+
+    std::atomic<bool> tracing_ = false;
+    std::mutex traceMutex_;
+    std::ofstream traceFile_;
+    std::string traceBuffer_;
+    bool traceEmpty_ = true;
+};
+
+Profiler &profiler();
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileStage stage) : stage_(stage), start_(Profiler::Clock::now()) {}
+    ~ProfileScope() { profiler().record(stage_, start_, Profiler::Clock::now()); }
+
+private:
+    ProfileStage stage_;
+    Profiler::Clock::time_point start_;
+};
+
+// Passes everything written to stream on to its previous buffer and counts the bytes, so that
+// what actually reaches the terminal can be measured. Not thread-safe.
+class CountingOutput : public std::streambuf {
+public:
+    explicit CountingOutput(std::ostream &stream) : stream_(stream), target_(stream.rdbuf()) {
+        stream_.rdbuf(this);
+    }
+    CountingOutput(const CountingOutput &) = delete;
+    CountingOutput &operator=(const CountingOutput &) = delete;
+    ~CountingOutput() override { stream_.rdbuf(target_); }
+
+    // Bytes written since the last call.
+    size_t take() { return std::exchange(written_, 0); }
+
+protected:
+    int_type overflow(int_type character) override;
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+    int sync() override { return target_->pubsync(); }
+
+private:
+    std::ostream &stream_;
+    std::streambuf *target_;
+    size_t written_ = 0;
+};
+
+// Traces to path for its lifetime, if path isn't empty.
+class TraceSession {
+public:
+    explicit TraceSession(const std::string &path) : active_(!path.empty()) {
+        if (active_)
+            profiler().startTrace(path);
+    }
+    ~TraceSession() {
+        if (active_)
+            profiler().stopTrace();
+    }
+
+private:
+    bool active_;
+};
+} // namespace cameracli
+#else
+#define PROFILE_SCOPE(stage) ((void)0)
+#define PROFILE_SPAN(stage, start, end) ((void)0)
+#define PROFILE_COUNT(counter) ((void)0)
+#define PROFILE_BYTES(bytes) ((void)0)
+#endif
@@ -0,0 +1,250 @@
+#include "server.hpp"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include "ansi.hpp"
+#include "capture.hpp"
+#include "pipeline.hpp"
+#include "stream.hpp"
+#endif
+
+#define SERVER_READ_SIZE 4096
+
+namespace cameracli {
+#ifdef _WIN32
+void runServer(const Options &) {
+    throw std::runtime_error("--serve needs Unix domain sockets, which aren't supported here");
+}
+#else
+namespace {
+using VariantKey = std::tuple<int, int, bool, bool, bool, bool, ColorDepth, bool>;
+
+VariantKey variantKey(const StreamHello &hello) {
+    auto &frameOptions = hello.frameOptions;
+    return {hello.columns,      hello.rows,          frameOptions.ascii, frameOptions.grayscale,
+            frameOptions.flipX, frameOptions.flipY,  frameOptions.colors, frameOptions.dither};
+}
+
+// Everything needed to render one terminal size and set of options. Frames are sent as full
+// redraws, since each client may skip any of them.
+struct Variant {
+    StreamHello hello;
+    FramePipeline pipeline;
+    AnsiEncoder encoder;
+    std::shared_ptr<std::string> message;
+    bool subscribed = false;
+};
+
+struct Client {
+    FileDescriptor socket;
+    MessageReader reader;
+    bool greeted = false;
+    StreamHello hello;
+    // The message being written and the newest one waiting behind it. A newer frame replaces the
+    // waiting one, so a slow client always gets the latest frame next and never falls behind.
+    std::shared_ptr<const std::string> sending, waiting;
+    size_t sent = 0;
+};
+
+// Writes as much as the socket takes without blocking. Returns false if the client is gone.
+bool flush(Client &client) {
+    while (true) {
+        if (!client.sending) {
+            if (!client.waiting)
+                return true;
+            client.sending = std::move(client.waiting);
+            client.sent = 0;
+        }
+        auto &message = *client.sending;
+        ssize_t written =
+            send(client.socket.get(), message.data() + client.sent, message.size() - client.sent,
+                 0);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.sent += written;
+        if (client.sent == message.size())
+            client.sending.reset();
+    }
+}
+
+// Reads whatever the client sent. Returns false if it disconnected or sent garbage.
+bool receive(Client &client) {
+    char data[SERVER_READ_SIZE];
+    while (true) {
+        ssize_t received = recv(client.socket.get(), data, sizeof(data), 0);
+        if (received == 0)
+            return false;
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            break;
+        }
+        client.reader.append(data, received);
+    }
+
+    try {
+        std::string_view payload;
+        while (client.reader.next(payload)) {
+            if (!decodeHello(payload, client.hello))
+                return false;
+            client.greeted = true;
+        }
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return true;
+}
+
+void render(Variant &variant, const FrameView &frame) {
+    auto &hello = variant.hello;
+    variant.encoder.invalidate();
+    variant.encoder.encode(
+        variant.pipeline.process(frame, hello.columns, hello.rows, hello.frameOptions));
+
+    // Reuse the previous message's buffer unless a client is still holding on to it.
+    if (!variant.message || variant.message.use_count() > 1)
+        variant.message = std::make_shared<std::string>();
+    auto &message = *variant.message;
+    message.clear();
+    size_t start = startMessage(message);
+    for (int y = 0; y < hello.rows; y++) {
+        fmt::format_to(std::back_inserter(message), "\x1b[{};1H", y + 1);
+        message += variant.encoder.row(y);
+    }
+    finishMessage(message, start);
+}
+
+// Renders the newest frame once per variant in use and queues it for every client.
+void broadcast(const FrameView &frame, std::vector<std::unique_ptr<Client>> &clients,
+               std::map<VariantKey, Variant> &variants) {
+    if (!frame.data[0])
+        return;
+    for (auto &client : clients) {
+        if (!client->greeted)
+            continue;
+        auto &variant = variants[variantKey(client->hello)];
+        if (!variant.subscribed) {
+            variant.hello = client->hello;
+            variant.subscribed = true;
+            render(variant, frame);
+        }
+        client->waiting = variant.message;
+    }
+    // Variants nobody asked for this time are dropped along with their buffers.
+    for (auto variant = variants.begin(); variant != variants.end();) {
+        if (variant->second.subscribed) {
+            variant->second.subscribed = false;
+            ++variant;
+        } else
+            variant = variants.erase(variant);
+    }
+}
+} // namespace
+
+void runServer(const Options &options) {
+    // Writing to a client that went away must fail with EPIPE rather than end the server.
+    std::signal(SIGPIPE, SIG_IGN);
+    SignalPipe signals({SIGINT, SIGTERM});
+
+    int ends[2];
+    if (pipe(ends) < 0)
+        throw std::runtime_error("couldn't create pipe");
+    FileDescriptor wakeRead(ends[0]), wakeWrite(ends[1]);
+    setNonBlocking(wakeRead.get());
+    setNonBlocking(wakeWrite.get());
+
+    ListeningSocket listener(options.serve);
+    CaptureThread capture(makeFrameSource(options.source, options.pixelFormat,
+                                          options.sourceWidth, options.sourceHeight,
+                                          GENERATED_FRAME_RATE),
+                          [&] {
+                              char byte = 0;
+                              (void)!write(wakeWrite.get(), &byte, 1);
+                          });
+    if (!capture.open())
+        throw std::runtime_error("couldn't open the capture device");
+    spdlog::info("serving {} on {}", options.source, options.serve);
+
+    std::vector<std::unique_ptr<Client>> clients;
+    std::map<VariantKey, Variant> variants;
+    std::vector<pollfd> descriptors;
+    while (true) {
+        auto watch = [&](int fd, short events) { descriptors.push_back({fd, events, 0}); };
+        descriptors.clear();
+        watch(signals.fd(), POLLIN);
+        watch(wakeRead.get(), POLLIN);
+        watch(listener.get(), POLLIN);
+        for (auto &client : clients)
+            watch(client->socket.get(),
+                  client->sending || client->waiting ? POLLIN | POLLOUT : POLLIN);
+        if (poll(descriptors.data(), descriptors.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("couldn't wait for clients");
+        }
+
+        if (descriptors[0].revents && signals.next())
+            break;
+
+        std::vector<bool> connected(clients.size(), true);
+        for (size_t i = 0; i < clients.size(); i++) {
+            auto &client = *clients[i];
+            short revents = descriptors[i + 3].revents;
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+                connected[i] = receive(client);
+            if (connected[i] && revents & POLLOUT)
+                connected[i] = flush(client);
+        }
+
+        if (descriptors[1].revents) {
+            char bytes[64];
+            while (read(wakeRead.get(), bytes, sizeof(bytes)) > 0) {
+            }
+            broadcast(capture.latest(), clients, variants);
+            for (size_t i = 0; i < clients.size(); i++)
+                connected[i] = connected[i] && flush(*clients[i]);
+        }
+
+        for (size_t i = clients.size(); i-- > 0;) {
+            if (!connected[i]) {
+                clients.erase(clients.begin() + i);
+                spdlog::info("client disconnected, {} left", clients.size());
+            }
+        }
+
+        if (descriptors[2].revents) {
+            int socket;
+            while ((socket = accept(listener.get(), nullptr, nullptr)) >= 0) {
+                auto client = std::make_unique<Client>();
+                client->socket = FileDescriptor(socket);
+                setNonBlocking(socket);
+                clients.push_back(std::move(client));
+                spdlog::info("client connected, {} in total", clients.size());
+            }
+        }
+    }
+}
+#endif
+} // namespace cameracli
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "options.hpp"
+
+namespace cameracli {
+// Captures from options.source and streams it to any number of clients over the Unix domain
+// socket at options.serve until interrupted. Clients that share a terminal size and frame
+// options share one rendering of each frame.
+void runServer(const Options &options);
+} // namespace cameracli
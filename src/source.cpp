@@ -0,0 +1,313 @@
+#include "source.hpp"
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <spdlog/fmt/fmt.h>
+
+namespace cameracli {
+namespace {
+ccap::PixelFormat cameraPixelFormat(FrameFormat format) {
+    switch (format) {
+    case FrameFormat::NV12:
+        return ccap::PixelFormat::NV12;
+    case FrameFormat::I420:
+        return ccap::PixelFormat::I420;
+    case FrameFormat::YUYV:
+        return ccap::PixelFormat::YUYV;
+    case FrameFormat::UYVY:
+        return ccap::PixelFormat::UYVY;
+    default:
+        return ccap::PixelFormat::RGB24;
+    }
+}
+
+// Formats ending in f are the full range variants.
+bool viewFrame(const ccap::VideoFrame &videoFrame, FrameView &view) {
+    view = {};
+    switch (videoFrame.pixelFormat) {
+    case ccap::PixelFormat::RGB24:
+        view.format = FrameFormat::RGB24;
+        break;
+    case ccap::PixelFormat::NV12f:
+        view.fullRange = true;
+        [[fallthrough]];
+    case ccap::PixelFormat::NV12:
+        view.format = FrameFormat::NV12;
+        break;
+    case ccap::PixelFormat::I420f:
+        view.fullRange = true;
+        [[fallthrough]];
+    case ccap::PixelFormat::I420:
+        view.format = FrameFormat::I420;
+        break;
+    case ccap::PixelFormat::YUYVf:
+        view.fullRange = true;
+        [[fallthrough]];
+    case ccap::PixelFormat::YUYV:
+        view.format = FrameFormat::YUYV;
+        break;
+    case ccap::PixelFormat::UYVYf:
+        view.fullRange = true;
+        [[fallthrough]];
+    case ccap::PixelFormat::UYVY:
+        view.format = FrameFormat::UYVY;
+        break;
+    default:
+        return false;
+    }
+    view.width = (int)videoFrame.width;
+    view.height = (int)videoFrame.height;
+    for (int plane = 0; plane < 3; plane++) {
+        view.data[plane] = videoFrame.data[plane];
+        view.stride[plane] = videoFrame.stride[plane];
+    }
+    return true;
+}
+
+// Repacks 8-bit RGB frames in another channel order into frame.buffer as RGB24. Backends that
+// can't deliver the format asked for may hand these out instead.
+bool packRgbFrame(const ccap::VideoFrame &videoFrame, CapturedFrame &frame) {
+    int channels, red, blue;
+    switch (videoFrame.pixelFormat) {
+    case ccap::PixelFormat::BGR24:
+        channels = 3, red = 2, blue = 0;
+        break;
+    case ccap::PixelFormat::RGBA32:
+        channels = 4, red = 0, blue = 2;
+        break;
+    case ccap::PixelFormat::BGRA32:
+        channels = 4, red = 2, blue = 0;
+        break;
+    default:
+        return false;
+    }
+    int width = (int)videoFrame.width, height = (int)videoFrame.height;
+    frame.buffer.resize((size_t)width * height * 3);
+    uint8_t *pixel = frame.buffer.data();
+    for (int y = 0; y < height; y++) {
+        const uint8_t *source = videoFrame.data[0] + (size_t)y * videoFrame.stride[0];
+        for (int x = 0; x < width; x++, source += channels, pixel += 3) {
+            pixel[0] = source[red];
+            pixel[1] = source[1];
+            pixel[2] = source[blue];
+        }
+    }
+    frame.view = FrameView::rgb(frame.buffer.data(), width, height, (size_t)width * 3);
+    return true;
+}
+} // namespace
+
+// The camera delivers its native format where it can, so that the colour conversion happens
+// after downscaling rather than at sensor resolution.
+CameraSource::CameraSource(FrameFormat format) {
+    cameraProvider_.set(ccap::PropertyName::PixelFormatInternal, cameraPixelFormat(format));
+    cameraProvider_.set(ccap::PropertyName::PixelFormatOutput, cameraPixelFormat(format));
+}
+
+bool CameraSource::open() { return cameraProvider_.open(); }
+
+bool CameraSource::read(CapturedFrame &frame, int timeout) {
+    auto videoFrame = cameraProvider_.grab(timeout);
+    if (!videoFrame)
+        return false;
+    // Frames are handed over as-is where possible; the slot keeps the ccap buffer alive while
+    // it's viewed. Other RGB layouts are copied, so the ccap buffer can go right away.
+    if (viewFrame(*videoFrame, frame.view)) {
+        frame.videoFrame = std::move(videoFrame);
+        return true;
+    }
+    frame.videoFrame.reset();
+    if (!packRgbFrame(*videoFrame, frame))
+        throw std::runtime_error(fmt::format("unsupported camera pixel format {}",
+                                             (uint32_t)videoFrame->pixelFormat));
+    return true;
+}
+
+void PacedSource::pace() {
+    if (frameRate_ <= 0)
+        return;
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1 / frameRate_));
+    auto now = std::chrono::steady_clock::now();
+    // Don't try to catch up after a stall, just carry on from now.
+    if (deadline_ + interval < now)
+        deadline_ = now;
+    std::this_thread::sleep_until(deadline_);
+    deadline_ += interval;
+}
+
+SyntheticSource::SyntheticSource(FrameFormat format, int width, int height, double frameRate)
+    : PacedSource(frameRate)
+    , format_(format)
+    , width_(width)
+    , height_(height) {}
+
+bool SyntheticSource::read(CapturedFrame &frame, int timeout) {
+    pace();
+    uint32_t t = frameIndex_++;
+    auto checker = [&](int x, int y) { return (x + t) / 64 % 2 == (uint32_t)y / 64 % 2; };
+
+    if (format_ == FrameFormat::RGB24) {
+        frame.buffer.resize((size_t)width_ * height_ * 3);
+        uint8_t *pixel = frame.buffer.data();
+        for (int y = 0; y < height_; y++) {
+            for (int x = 0; x < width_; x++, pixel += 3) {
+                pixel[0] = x + t;
+                pixel[1] = y + t * 2;
+                pixel[2] = checker(x, y) ? 224 : 32;
+            }
+        }
+        frame.view = FrameView::rgb(frame.buffer.data(), width_, height_, (size_t)width_ * 3);
+        return true;
+    }
+
+    // The same kind of pattern, drawn straight into the requested YUV layout.
+    auto luma = [&](int x, int y) { return (uint8_t)((checker(x, y) ? 160 : 48) + (x + t) % 48); };
+    auto blue = [&](int x) { return (uint8_t)(x * 2 + t); };
+    auto red = [&](int y) { return (uint8_t)(y * 2 + t * 2); };
+    int chromaWidth = (width_ + 1) / 2, chromaHeight = (height_ + 1) / 2;
+    auto &view = frame.view;
+    view = {format_, width_, height_};
+
+    if (format_ == FrameFormat::YUYV || format_ == FrameFormat::UYVY) {
+        frame.buffer.resize((size_t)chromaWidth * 4 * height_);
+        bool yuyv = format_ == FrameFormat::YUYV;
+        uint8_t *pixel = frame.buffer.data();
+        for (int y = 0; y < height_; y++) {
+            for (int x = 0; x < chromaWidth; x++, pixel += 4) {
+                pixel[yuyv ? 0 : 1] = luma(x * 2, y);
+                pixel[yuyv ? 2 : 3] = luma(x * 2 + 1, y);
+                pixel[yuyv ? 1 : 0] = blue(x);
+                pixel[yuyv ? 3 : 2] = red(y / 2);
+            }
+        }
+        view.data[0] = frame.buffer.data();
+        view.stride[0] = (size_t)chromaWidth * 4;
+        return true;
+    }
+
+    size_t lumaSize = (size_t)width_ * height_, chromaSize = (size_t)chromaWidth * chromaHeight;
+    frame.buffer.resize(lumaSize + chromaSize * 2);
+    uint8_t *pixel = frame.buffer.data();
+    for (int y = 0; y < height_; y++)
+        for (int x = 0; x < width_; x++)
+            *pixel++ = luma(x, y);
+    view.data[0] = frame.buffer.data();
+    view.stride[0] = width_;
+    view.data[1] = view.data[0] + lumaSize;
+    if (format_ == FrameFormat::NV12) {
+        view.stride[1] = (size_t)chromaWidth * 2;
+        for (int y = 0; y < chromaHeight; y++) {
+            for (int x = 0; x < chromaWidth; x++, pixel += 2) {
+                pixel[0] = blue(x);
+                pixel[1] = red(y);
+            }
+        }
+    } else {
+        view.data[2] = view.data[1] + chromaSize;
+        view.stride[1] = view.stride[2] = chromaWidth;
+        for (int y = 0; y < chromaHeight; y++) {
+            for (int x = 0; x < chromaWidth; x++, pixel++) {
+                pixel[0] = blue(x);
+                pixel[chromaSize] = red(y);
+            }
+        }
+    }
+    return true;
+}
+
+FileSource::FileSource(std::string path, int width, int height, double frameRate)
+    : PacedSource(frameRate)
+    , path_(std::move(path))
+    , width_(width)
+    , height_(height) {}
+
+bool FileSource::open() {
+    file_.open(path_, std::ios::binary);
+    if (!file_)
+        throw std::runtime_error("couldn't open " + path_);
+    readHeader();
+    dataStart_ = file_.tellg();
+    return true;
+}
+
+void FileSource::readHeader() {
+    char magic[10] = {};
+    file_.read(magic, 10);
+    if (!file_ || std::string_view(magic, 10) != "YUV4MPEG2 ") {
+        file_.clear();
+        file_.seekg(0);
+        return;
+    }
+
+    y4m_ = true;
+    std::string header;
+    std::getline(file_, header);
+    std::istringstream parameters(header);
+    std::string parameter;
+    while (parameters >> parameter) {
+        if (parameter[0] == 'W')
+            width_ = std::stoi(parameter.substr(1));
+        else if (parameter[0] == 'H')
+            height_ = std::stoi(parameter.substr(1));
+        // Other colour spaces have different subsampling or more than 8 bits per sample.
+        else if (parameter[0] == 'C' && parameter != "C420" && parameter != "C420jpeg" &&
+                 parameter != "C420mpeg2" && parameter != "C420paldv")
+            throw std::runtime_error("unsupported Y4M colour space " + parameter.substr(1));
+        else if (parameter == "XCOLORRANGE=FULL")
+            fullRange_ = true;
+    }
+}
+
+bool FileSource::read(CapturedFrame &frame, int timeout) {
+    pace();
+    if (readFrame(frame))
+        return true;
+    // Loop back to the first frame.
+    file_.clear();
+    file_.seekg(dataStart_);
+    return readFrame(frame);
+}
+
+bool FileSource::readFrame(CapturedFrame &frame) {
+    if (!y4m_) {
+        frame.buffer.resize((size_t)width_ * height_ * 3);
+        frame.view = FrameView::rgb(frame.buffer.data(), width_, height_, (size_t)width_ * 3);
+        return (bool)file_.read((char *)frame.buffer.data(), frame.buffer.size());
+    }
+
+    // Each frame is "FRAME", optional parameters and a newline, then the Y, U and V planes,
+    // which are passed on as I420 without converting them.
+    char magic[5];
+    if (!file_.read(magic, 5) || std::string_view(magic, 5) != "FRAME")
+        return false;
+    file_.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    int chromaWidth = (width_ + 1) / 2, chromaHeight = (height_ + 1) / 2;
+    size_t lumaSize = (size_t)width_ * height_, chromaSize = (size_t)chromaWidth * chromaHeight;
+    frame.buffer.resize(lumaSize + chromaSize * 2);
+    if (!file_.read((char *)frame.buffer.data(), frame.buffer.size()))
+        return false;
+
+    auto &view = frame.view;
+    view = {FrameFormat::I420, width_, height_};
+    view.data[0] = frame.buffer.data();
+    view.data[1] = view.data[0] + lumaSize;
+    view.data[2] = view.data[1] + chromaSize;
+    view.stride[0] = width_;
+    view.stride[1] = view.stride[2] = chromaWidth;
+    view.fullRange = fullRange_;
+    return true;
+}
+
+std::unique_ptr<FrameSource> makeFrameSource(const std::string &source, FrameFormat format,
+                                             int width, int height, double frameRate) {
+    if (source == "camera")
+        return std::make_unique<CameraSource>(format);
+    if (source == "synthetic")
+        return std::make_unique<SyntheticSource>(format, width, height, frameRate);
+    return std::make_unique<FileSource>(source, width, height, frameRate);
+}
+} // namespace cameracli
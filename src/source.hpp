@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ccap.h>
+
+#include "frame.hpp"
+
+// Frame rate of synthetic and file sources when they stand in for a camera.
+#define GENERATED_FRAME_RATE 30
+
+namespace cameracli {
+// A frame handed out by a FrameSource. Camera frames are viewed in place and kept alive through
+// videoFrame; generated and file frames are written into buffer, which is reused between reads.
+struct CapturedFrame {
+    std::shared_ptr<ccap::VideoFrame> videoFrame;
+    std::vector<uint8_t> buffer;
+    FrameView view;
+};
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+    virtual bool open() = 0;
+    // Fills frame with the next image. Returns false if none arrived within timeout milliseconds.
+    virtual bool read(CapturedFrame &frame, int timeout) = 0;
+};
+
+class CameraSource : public FrameSource {
+public:
+    // format is what the camera is asked for; frames in another supported format, or in BGR24,
+    // RGBA32 or BGRA32, are still accepted, since not every camera offers every format.
+    explicit CameraSource(FrameFormat format);
+    bool open() override;
+    bool read(CapturedFrame &frame, int timeout) override;
+
+private:
+    ccap::Provider cameraProvider_;
+};
+
+// Sources that don't come from a device can either produce frames as fast as they are read, for
+// benchmarks, or at frameRate frames per second, to stand in for a camera.
+class PacedSource : public FrameSource {
+public:
+    explicit PacedSource(double frameRate) : frameRate_(frameRate) {}
+
+protected:
+    void pace();
+
+private:
+    double frameRate_;
+    std::chrono::steady_clock::time_point deadline_;
+};
+
+// Deterministic moving test pattern, so runs are reproducible without a camera.
+class SyntheticSource : public PacedSource {
+public:
+    SyntheticSource(FrameFormat format, int width, int height, double frameRate);
+    bool open() override { return true; }
+    bool read(CapturedFrame &frame, int timeout) override;
+
+private:
+    FrameFormat format_;
+    int width_, height_;
+    uint32_t frameIndex_ = 0;
+};
+
+// Reads raw RGB24 frames of a known size, or YUV4MPEG2 (.y4m) streams with 4:2:0 chroma, which
+// come out as I420. The file is looped when it runs out.
+class FileSource : public PacedSource {
+public:
+    FileSource(std::string path, int width, int height, double frameRate);
+    bool open() override;
+    bool read(CapturedFrame &frame, int timeout) override;
+
+private:
+    void readHeader();
+    bool readFrame(CapturedFrame &frame);
+
+    std::string path_;
+    std::ifstream file_;
+    std::streampos dataStart_;
+    int width_, height_;
+    bool y4m_ = false, fullRange_ = false;
+};
+
+// "camera", "synthetic" or a file path. format is the pixel format asked of cameras and
+// generated by the synthetic source; files have their own. width and height give the size of
+// synthetic and raw frames; frameRate 0 produces generated frames as fast as they are read.
+std::unique_ptr<FrameSource> makeFrameSource(const std::string &source, FrameFormat format,
+                                             int width, int height, double frameRate);
+} // namespace cameracli
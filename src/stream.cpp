@@ -0,0 +1,233 @@
+#include "stream.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define STREAM_PROTOCOL_VERSION 2
+#define STREAM_MAXIMUM_MESSAGE_SIZE (64 << 20)
+#define STREAM_MAXIMUM_CELLS 4096
+
+namespace cameracli {
+namespace {
+enum HelloFlag : uint8_t {
+    HELLO_ASCII = 1,
+    HELLO_GRAYSCALE = 2,
+    HELLO_FLIP_X = 4,
+    HELLO_FLIP_Y = 8,
+    HELLO_DITHER = 16,
+};
+
+void appendUint16(std::string &buffer, int value) {
+    buffer += (char)(value & 0xFF);
+    buffer += (char)(value >> 8 & 0xFF);
+}
+
+int readUint16(const char *data) { return (uint8_t)data[0] | (uint8_t)data[1] << 8; }
+
+uint32_t readUint32(const char *data) {
+    return (uint32_t)readUint16(data) | (uint32_t)readUint16(data + 2) << 16;
+}
+} // namespace
+
+size_t startMessage(std::string &buffer) {
+    size_t start = buffer.size();
+    buffer.append(4, '\0');
+    return start;
+}
+
+void finishMessage(std::string &buffer, size_t start) {
+    uint32_t size = buffer.size() - start - 4;
+    for (int i = 0; i < 4; i++)
+        buffer[start + i] = (char)(size >> i * 8 & 0xFF);
+}
+
+std::string encodeHello(const StreamHello &hello) {
+    std::string message;
+    size_t start = startMessage(message);
+    message += (char)STREAM_PROTOCOL_VERSION;
+    appendUint16(message, hello.columns);
+    appendUint16(message, hello.rows);
+    auto &frameOptions = hello.frameOptions;
+    message += (char)((frameOptions.ascii ? HELLO_ASCII : 0) |
+                      (frameOptions.grayscale ? HELLO_GRAYSCALE : 0) |
+                      (frameOptions.flipX ? HELLO_FLIP_X : 0) |
+                      (frameOptions.flipY ? HELLO_FLIP_Y : 0) |
+                      (frameOptions.dither ? HELLO_DITHER : 0));
+    message += (char)frameOptions.colors;
+    finishMessage(message, start);
+    return message;
+}
+
+bool decodeHello(std::string_view payload, StreamHello &hello) {
+    if (payload.size() != 7 || payload[0] != STREAM_PROTOCOL_VERSION ||
+        (uint8_t)payload[6] > (uint8_t)ColorDepth::Palette16)
+        return false;
+    hello.columns = readUint16(payload.data() + 1);
+    hello.rows = readUint16(payload.data() + 3);
+    uint8_t flags = payload[5];
+    hello.frameOptions = {(flags & HELLO_ASCII) != 0,  (flags & HELLO_FLIP_X) != 0,
+                          (flags & HELLO_FLIP_Y) != 0, (flags & HELLO_GRAYSCALE) != 0,
+                          (ColorDepth)payload[6],      (flags & HELLO_DITHER) != 0};
+    return hello.columns > 0 && hello.columns <= STREAM_MAXIMUM_CELLS && hello.rows > 0 &&
+           hello.rows <= STREAM_MAXIMUM_CELLS;
+}
+
+void MessageReader::append(const char *data, size_t size) {
+    // Drop what has been read already, so the buffer only grows to one message.
+    buffer_.erase(0, offset_);
+    offset_ = 0;
+    buffer_.append(data, size);
+}
+
+bool MessageReader::next(std::string_view &payload) {
+    if (buffer_.size() - offset_ < 4)
+        return false;
+    uint32_t size = readUint32(buffer_.data() + offset_);
+    if (size > STREAM_MAXIMUM_MESSAGE_SIZE)
+        throw std::runtime_error("received an oversized message");
+    if (buffer_.size() - offset_ - 4 < size)
+        return false;
+    payload = std::string_view(buffer_).substr(offset_ + 4, size);
+    offset_ += 4 + size;
+    return true;
+}
+
+#ifndef _WIN32
+namespace {
+int signalPipeWrite = -1;
+
+void forwardSignal(int signal) {
+    int error = errno;
+    char byte = (char)signal;
+    (void)!write(signalPipeWrite, &byte, 1);
+    errno = error;
+}
+
+std::runtime_error systemError(const std::string &what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un socketAddress(const std::string &path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("socket path too long: " + path);
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+} // namespace
+
+FileDescriptor &FileDescriptor::operator=(FileDescriptor &&other) noexcept {
+    if (this != &other) {
+        if (fd_ >= 0)
+            close(fd_);
+        fd_ = std::exchange(other.fd_, -1);
+    }
+    return *this;
+}
+
+FileDescriptor::~FileDescriptor() {
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void setNonBlocking(int fd) {
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        throw systemError("couldn't make descriptor non-blocking");
+}
+
+void writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            throw systemError("couldn't write");
+        data.remove_prefix(written);
+    }
+}
+
+FileDescriptor connectTo(const std::string &path) {
+    auto address = socketAddress(path);
+    FileDescriptor connection(socket(AF_UNIX, SOCK_STREAM, 0));
+    if (connection.get() < 0)
+        throw systemError("couldn't create socket");
+    if (connect(connection.get(), (const sockaddr *)&address, sizeof(address)) < 0)
+        return {};
+    return connection;
+}
+
+ListeningSocket::ListeningSocket(const std::string &path) : path_(path) {
+    auto address = socketAddress(path);
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode))
+            throw std::runtime_error(path + " exists and is not a socket");
+        if (connectTo(path).get() >= 0)
+            throw std::runtime_error(path + " is already being served");
+        unlink(path.c_str());
+    }
+
+    socket_ = FileDescriptor(socket(AF_UNIX, SOCK_STREAM, 0));
+    if (socket_.get() < 0)
+        throw systemError("couldn't create socket");
+    if (bind(socket_.get(), (const sockaddr *)&address, sizeof(address)) < 0)
+        throw systemError("couldn't bind " + path);
+    if (lstat(path.c_str(), &status) == 0) {
+        device_ = status.st_dev;
+        inode_ = status.st_ino;
+    }
+    if (listen(socket_.get(), SOMAXCONN) < 0) {
+        auto error = systemError("couldn't listen on " + path);
+        unlink(path.c_str());
+        throw error;
+    }
+    setNonBlocking(socket_.get());
+}
+
+ListeningSocket::~ListeningSocket() {
+    struct stat status;
+    if (lstat(path_.c_str(), &status) == 0 && S_ISSOCK(status.st_mode) &&
+        status.st_dev == device_ && status.st_ino == inode_)
+        unlink(path_.c_str());
+}
+
+SignalPipe::SignalPipe(std::initializer_list<int> signals) : signals_(signals) {
+    int ends[2];
+    if (pipe(ends) < 0)
+        throw systemError("couldn't create pipe");
+    read_ = FileDescriptor(ends[0]);
+    write_ = FileDescriptor(ends[1]);
+    setNonBlocking(read_.get());
+    setNonBlocking(write_.get());
+    signalPipeWrite = write_.get();
+
+    struct sigaction action = {};
+    action.sa_handler = forwardSignal;
+    sigemptyset(&action.sa_mask);
+    for (int signal : signals_)
+        sigaction(signal, &action, nullptr);
+}
+
+SignalPipe::~SignalPipe() {
+    for (int signal : signals_)
+        std::signal(signal, SIG_DFL);
+    signalPipeWrite = -1;
+}
+
+int SignalPipe::next() {
+    char byte;
+    return read(read_.get(), &byte, 1) == 1 ? (uint8_t)byte : 0;
+}
+#endif
+} // namespace cameracli
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cells.hpp"
+
+namespace cameracli {
+// Server and clients exchange messages of a 32-bit little-endian payload size followed by the
+// payload. A client sends a hello when it connects and whenever its terminal size or options
+// change, including the colour depth of its own terminal; the server answers with frames, each
+// the escape sequences that redraw the whole terminal, so a client can start with any of them
+// and skip any number.
+struct StreamHello {
+    int columns = 0, rows = 0;
+    FrameOptions frameOptions{};
+};
+
+// Starts a message in buffer and returns where it starts; the payload is appended after it and
+// finishMessage() fills in its size.
+size_t startMessage(std::string &buffer);
+void finishMessage(std::string &buffer, size_t start);
+
+std::string encodeHello(const StreamHello &hello);
+// Returns false if payload isn't a valid hello.
+bool decodeHello(std::string_view payload, StreamHello &hello);
+
+// Splits a byte stream back into messages.
+class MessageReader {
+public:
+    void append(const char *data, size_t size);
+    // Takes the next complete message, if there is one. payload stays valid until the next
+    // append(). Throws if the message is implausibly large.
+    bool next(std::string_view &payload);
+
+private:
+    std::string buffer_;
+    size_t offset_ = 0;
+};
+
+#ifndef _WIN32
+// Owns a POSIX file descriptor.
+class FileDescriptor {
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    FileDescriptor(FileDescriptor &&other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    FileDescriptor &operator=(FileDescriptor &&other) noexcept;
+    ~FileDescriptor();
+
+    int get() const { return fd_; }
+
+private:
+    int fd_ = -1;
+};
+
+void setNonBlocking(int fd);
+// Writes all of data to a blocking descriptor.
+void writeAll(int fd, std::string_view data);
+FileDescriptor connectTo(const std::string &path);
+
+// Listens on a Unix domain socket at path. A socket left behind there by a server that didn't
+// shut down cleanly is replaced, but anything else at path is left alone. The socket file is
+// removed on destruction, unless it has been replaced in the meantime.
+class ListeningSocket {
+public:
+    explicit ListeningSocket(const std::string &path);
+    ListeningSocket(const ListeningSocket &) = delete;
+    ListeningSocket &operator=(const ListeningSocket &) = delete;
+    ~ListeningSocket();
+
+    int get() const { return socket_.get(); }
+
+private:
+    FileDescriptor socket_;
+    std::string path_;
+    uint64_t device_ = 0, inode_ = 0;
+};
+
+// Forwards signals to a pipe, so that a poll() loop can handle them. Only one may exist at a
+// time; the default handlers are restored on destruction.
+class SignalPipe {
+public:
+    explicit SignalPipe(std::initializer_list<int> signals);
+    ~SignalPipe();
+    int fd() const { return read_.get(); }
+    // The next signal received, or 0 if there are none left.
+    int next();
+
+private:
+    FileDescriptor read_, write_;
+    std::vector<int> signals_;
+};
+#endif
+} // namespace cameracli
@@ -0,0 +1,117 @@
+// Checks that once buffers have warmed up, frames go through FramePipeline and AnsiEncoder
+// without a single heap allocation, in every mode and pixel format and while switching between
+// modes and reduction levels.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "pipeline.hpp"
+#include "source.hpp"
+
+#define ALLOCATION_TEST_WARM_UP_FRAMES 3
+#define ALLOCATION_TEST_FRAMES 20
+#define ALLOCATION_TEST_COLUMNS 160
+#define ALLOCATION_TEST_ROWS 45
+
+namespace {
+std::atomic<long> allocations = 0;
+} // namespace
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+// stb_image_resize2 allocates its samplers through this one.
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+void operator delete(void *memory, const std::nothrow_t &) noexcept { std::free(memory); }
+
+using namespace cameracli;
+
+namespace {
+struct Setting {
+    FrameOptions frameOptions;
+    int reduction;
+};
+
+std::string describe(const Setting &setting) {
+    auto &frameOptions = setting.frameOptions;
+    return std::string(frameOptions.ascii ? "ascii" : "halfblock") +
+           (frameOptions.grayscale ? " grayscale" : "") + (frameOptions.flipX ? " flip-x" : "") +
+           (frameOptions.flipY ? " flip-y" : "") + " colours " +
+           std::string(colorDepthName(frameOptions.colors)) +
+           (frameOptions.dither ? " dithered" : "") + " reduction " +
+           std::to_string(setting.reduction);
+}
+} // namespace
+
+int main() {
+    std::vector<Setting> settings;
+    for (int reduction = 0; reduction <= 2; reduction++) {
+        for (int flags = 0; flags < 4; flags++) {
+            bool ascii = flags & 1, grayscale = flags & 2;
+            settings.push_back({{ascii, false, false, grayscale}, reduction});
+        }
+    }
+    settings.push_back({{false, true, true, false, ColorDepth::Palette256, true}, 0});
+    settings.push_back({{true, false, true, false, ColorDepth::Palette16, false}, 1});
+
+    int failures = 0;
+    for (auto format : {FrameFormat::RGB24, FrameFormat::NV12, FrameFormat::I420,
+                        FrameFormat::YUYV, FrameFormat::UYVY}) {
+        // Two different frames, so every frame has cells to encode.
+        SyntheticSource source(format, 1280, 720, 0);
+        CapturedFrame frames[2];
+        for (auto &frame : frames)
+            source.read(frame, 0);
+
+        FramePipeline pipeline;
+        AnsiEncoder encoder;
+        auto render = [&](const Setting &setting, int frame) {
+            encoder.encode(pipeline.process(frames[frame % 2].view, ALLOCATION_TEST_COLUMNS,
+                                            ALLOCATION_TEST_ROWS, setting.frameOptions,
+                                            setting.reduction));
+        };
+        auto report = [&](long counted, const std::string &what) {
+            if (!counted)
+                return;
+            failures++;
+            std::printf("%s %s: %ld allocations\n", frameFormatName(format).data(), what.c_str(),
+                        counted);
+        };
+
+        for (auto &setting : settings) {
+            for (int i = 0; i < ALLOCATION_TEST_WARM_UP_FRAMES; i++)
+                render(setting, i);
+            long before = allocations;
+            for (int i = 0; i < ALLOCATION_TEST_FRAMES; i++)
+                render(setting, i);
+            long counted = allocations - before;
+            report(counted, describe(setting));
+        }
+
+        // Every setting was used above, and the pipeline keeps buffers and resize samplers for
+        // all of their sizes, so switching between them has nothing left to allocate.
+        long before = allocations;
+        for (int i = 0; i < ALLOCATION_TEST_FRAMES; i++) {
+            for (auto &setting : settings)
+                render(setting, i);
+        }
+        long counted = allocations - before;
+        report(counted, "switching settings");
+    }
+    std::printf("%d allocating cases\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+// Checks that the SSE2 and AVX2 row kernels produce exactly the cells the scalar kernel does,
+// for every mode and flip and for widths that exercise the vector tails.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "cells.hpp"
+
+#define KERNEL_TEST_MAXIMUM_WIDTH 70
+#define KERNEL_TEST_HEIGHT 6
+
+using namespace cameracli;
+
+namespace {
+bool sameCells(const CellGrid &a, const CellGrid &b) {
+    return a.mode == b.mode && a.width == b.width && a.height == b.height &&
+           a.glyphs == b.glyphs && a.foreground == b.foreground && a.background == b.background;
+}
+} // namespace
+
+int main() {
+    std::vector<Kernel> kernels;
+    if (bestKernel() != Kernel::Scalar)
+        kernels.push_back(Kernel::Sse2);
+    if (bestKernel() == Kernel::Avx2)
+        kernels.push_back(Kernel::Avx2);
+    if (kernels.empty()) {
+        std::printf("no vector kernels on this CPU\n");
+        return 0;
+    }
+
+    std::mt19937 random(1);
+    std::vector<uint8_t> pixels;
+    CellGrid expected, actual;
+    int failures = 0, comparisons = 0;
+    for (int width = 1; width <= KERNEL_TEST_MAXIMUM_WIDTH; width++) {
+        pixels.resize((size_t)width * KERNEL_TEST_HEIGHT * 3);
+        for (auto &pixel : pixels)
+            pixel = (uint8_t)random();
+        for (int flags = 0; flags < 16; flags++) {
+            FrameOptions frameOptions = {(flags & 1) != 0, (flags & 2) != 0, (flags & 4) != 0,
+                                         (flags & 8) != 0};
+            convertToCells(pixels.data(), width, KERNEL_TEST_HEIGHT, frameOptions, expected,
+                           Kernel::Scalar);
+            for (auto kernel : kernels) {
+                convertToCells(pixels.data(), width, KERNEL_TEST_HEIGHT, frameOptions, actual,
+                               kernel);
+                comparisons++;
+                if (!sameCells(expected, actual)) {
+                    failures++;
+                    std::printf("%s differs from scalar at width %d (ascii %d, flip x %d, "
+                                "flip y %d, grayscale %d)\n",
+                                kernelName(kernel).data(), width, frameOptions.ascii,
+                                frameOptions.flipX, frameOptions.flipY, frameOptions.grayscale);
+                }
+            }
+        }
+    }
+    std::printf("%d of %d comparisons differ\n", failures, comparisons);
+    return failures ? 1 : 0;
+}